@@ -0,0 +1,163 @@
+#pragma once
+
+#include <iostream>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include <omp.h>
+
+constexpr size_t CACHE_LINE = 64;
+constexpr size_t HUGE_PAGE = size_t(2) << 20;
+
+// None - обычные страницы, Transparent - выравнивание на 2 МБ и madvise(MADV_HUGEPAGE),
+// Explicit - mmap(MAP_HUGETLB) из заранее выделенного пула (при неудаче - Transparent)
+enum class HugePages { None, Transparent, Explicit };
+
+// Неинициализированный массив, выровненный на кэш-линию (64 байта).
+// Память не трогается при выделении: страницы попадают на NUMA-узел того потока,
+// который первым в них запишет, поэтому инициализировать массив нужно с тем же
+// разбиением, что и вычисления (или вызвать firstTouch).
+template <typename T>
+class AlignedBuffer {
+public:
+    AlignedBuffer() = default;
+
+    explicit AlignedBuffer(size_t length, HugePages pages = HugePages::Transparent) : len_(length)
+    {
+        bytes_ = (length * sizeof(T) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+        if (bytes_ == 0) return;
+
+        if (bytes_ < HUGE_PAGE) pages = HugePages::None;
+
+        if (pages == HugePages::Explicit)
+        {
+            size_t mapped = (bytes_ + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+            void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+            {
+                ptr_ = static_cast<T*>(p);
+                bytes_ = mapped;
+                mapped_ = true;
+                return;
+            }
+            pages = HugePages::Transparent;
+        }
+
+        size_t alignment = (pages == HugePages::Transparent) ? HUGE_PAGE : CACHE_LINE;
+        if (pages == HugePages::Transparent) bytes_ = (bytes_ + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+
+        void* p = nullptr;
+        if (posix_memalign(&p, alignment, bytes_) != 0)
+        {
+            std::cerr << "Aligned allocation of " << bytes_ << " bytes failed" << std::endl;
+            throw std::bad_alloc();
+        }
+#ifdef MADV_HUGEPAGE
+        if (pages == HugePages::Transparent) madvise(p, bytes_, MADV_HUGEPAGE);
+#endif
+        ptr_ = static_cast<T*>(p);
+    }
+
+    ~AlignedBuffer() { release(); }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept { swap(other); }
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            swap(other);
+        }
+        return *this;
+    }
+
+    // Обнуляет массив блоками schedule(static) по numThreads потокам -
+    // так же, как его затем делят циклы #pragma omp for
+    void firstTouch(int numThreads)
+    {
+        T* data = ptr_;
+        long long n = (long long)len_;
+
+        #pragma omp parallel for schedule(static) num_threads(numThreads)
+        for (long long i = 0; i < n; i++)
+        {
+            data[i] = T();
+        }
+    }
+
+    T* get() const { return ptr_; }
+    T* data() const { return ptr_; }
+    size_t size() const { return len_; }
+
+    T& operator[](size_t i) const { return ptr_[i]; }
+
+private:
+    T* ptr_ = nullptr;
+    size_t len_ = 0;
+    size_t bytes_ = 0;
+    bool mapped_ = false;
+
+    void swap(AlignedBuffer& other) noexcept
+    {
+        std::swap(ptr_, other.ptr_);
+        std::swap(len_, other.len_);
+        std::swap(bytes_, other.bytes_);
+        std::swap(mapped_, other.mapped_);
+    }
+
+    void release()
+    {
+        if (!ptr_) return;
+        if (mapped_) munmap(ptr_, bytes_);
+        else std::free(ptr_);
+        ptr_ = nullptr;
+    }
+};
+
+// Аллокатор для std::vector с тем же выравниванием. construct() без аргументов
+// не обнуляет элементы, чтобы первое касание оставалось за вычислительными потоками.
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        size_t bytes = (n * sizeof(T) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+        size_t alignment = bytes >= HUGE_PAGE ? HUGE_PAGE : CACHE_LINE;
+        void* p = nullptr;
+        if (posix_memalign(&p, alignment, bytes) != 0) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        if (bytes >= HUGE_PAGE) madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t) noexcept { std::free(p); }
+
+    template <typename U>
+    void construct(U* p) noexcept { ::new (static_cast<void*>(p)) U; }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const noexcept { return false; }
+};
+
+template <typename T>
+using aligned_vector = std::vector<T, AlignedAllocator<T>>;
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Выбирает, через сколько итераций снова считать ошибку.
+// Ошибка метода Якоби убывает примерно геометрически: e(k) ~ C * q^k,
+// поэтому по двум последним замерам оцениваем ln q и число итераций до eps.
+// Следующая проверка назначается чуть раньше прогноза, так что перелёт за eps
+// ограничен minInterval, а не целой пачкой итераций.
+class ConvergenceMonitor {
+public:
+    ConvergenceMonitor(double eps, int initialInterval, int minInterval, int maxInterval = 1 << 20)
+        : eps_(eps), interval_(initialInterval), minInterval_(minInterval), maxInterval_(maxInterval) {}
+
+    // Итераций до следующей проверки
+    int interval() const { return interval_; }
+
+    double rate() const { return logRate_; }
+
+    void record(int iteration, double error)
+    {
+        history_.push_back({ iteration, error });
+        if (history_.size() < 2 || error <= eps_) return;
+
+        const Sample& prev = history_[history_.size() - 2];
+        if (prev.error > 0 && error > 0 && iteration > prev.iteration)
+        {
+            logRate_ = (std::log(error) - std::log(prev.error)) / (iteration - prev.iteration);
+        }
+
+        int next;
+        if (logRate_ < 0)
+        {
+            // Прогноз с запасом 10%, интервал растёт не более чем вдвое за раз
+            double predicted = std::log(eps_ / error) / logRate_;
+            next = int(std::min(0.9 * predicted, 2.0 * interval_));
+        }
+        else
+        {
+            // Ошибка пока не убывает - проверяем всё реже
+            next = 2 * interval_;
+        }
+        interval_ = std::clamp(next, minInterval_, maxInterval_);
+    }
+
+    // Пишет историю в виде "итерация ошибка" по строке на проверку
+    bool save(const std::string& filename) const
+    {
+        std::ofstream file(filename);
+        if (!file.is_open())
+        {
+            std::cerr << "Unable to open file " << filename << " for writing." << std::endl;
+            return false;
+        }
+
+        file.precision(6);
+        file << std::scientific;
+        for (const Sample& s : history_)
+        {
+            file << s.iteration << ' ' << s.error << '\n';
+        }
+        return true;
+    }
+
+    size_t checks() const { return history_.size(); }
+
+private:
+    struct Sample {
+        int iteration;
+        double error;
+    };
+
+    double eps_;
+    int interval_;
+    int minInterval_;
+    int maxInterval_;
+    double logRate_ = 0;
+    std::vector<Sample> history_;
+};
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+// Двоичный формат сетки (.grd): заголовок, таблица блоков и сами блоки.
+// Сетка режется на блоки по blockRows строк; блоки сжимаются параллельно
+// и пишутся pwrite со своих смещений, тоже параллельно.
+//   lossless - исходные double + zstd; без USE_ZSTD не пишется - сырые double
+//              больше текстового дампа (файлы GRID_RAW по-прежнему читаются);
+//   lossy    - квантование с шагом 2 * errorBound (|ошибка| <= errorBound),
+//              разности соседних значений в zigzag-varint (+ zstd).
+// Чтение - loadGrid, утилита Task_6/gridcat.cpp.
+
+enum GridCodec : uint32_t {
+    GRID_RAW = 0,
+    GRID_QUANTIZED = 1,
+    GRID_ZSTD = 2
+};
+
+struct GridHeader {
+    char magic[4] = { 'G', 'R', 'D', '1' };
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+    uint32_t blockRows = 0;
+    uint32_t blockCount = 0;
+    uint32_t codec = GRID_RAW;
+    double errorBound = 0.0;
+};
+
+struct GridBlock {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct GridOptions {
+    bool lossy = false;
+    double errorBound = 1e-4;
+    int blockRows = 64;
+    int zstdLevel = 3;
+};
+
+namespace grid_detail {
+
+inline void putVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+// Самый длинный varint 64-битного числа
+constexpr size_t MAX_VARINT = 10;
+
+// false, если число обрывается на end или длиннее 64 бит
+inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (p == end) return false;
+        uint8_t byte = *p++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// false, если значение не квантуется (не конечно или не помещается в int64) или zstd вернул ошибку
+inline bool encode(const double* data, size_t count, const GridHeader& header, int level, std::vector<uint8_t>& out)
+{
+    std::vector<uint8_t> raw;
+    if (header.codec & GRID_QUANTIZED)
+    {
+        raw.reserve(count * 2);
+        const double step = 2.0 * header.errorBound;
+        // Разность двух квантов тоже должна помещаться в int64
+        const double limit = 0x1p61;
+        int64_t prev = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            double scaled = data[i] / step;
+            if (!(std::abs(scaled) < limit)) return false;
+            int64_t q = std::llround(scaled);
+            int64_t delta = q - prev;
+            prev = q;
+            putVarint(raw, (uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+        }
+    }
+    else
+    {
+        raw.resize(count * sizeof(double));
+        std::memcpy(raw.data(), data, raw.size());
+    }
+
+#ifdef USE_ZSTD
+    if (header.codec & GRID_ZSTD)
+    {
+        out.resize(ZSTD_compressBound(raw.size()));
+        size_t size = ZSTD_compress(out.data(), out.size(), raw.data(), raw.size(), level);
+        if (ZSTD_isError(size)) return false;
+        out.resize(size);
+        return true;
+    }
+#else
+    (void)level;
+#endif
+    out = std::move(raw);
+    return true;
+}
+
+inline bool decode(const std::vector<uint8_t>& block, double* data, size_t count, const GridHeader& header)
+{
+    const std::vector<uint8_t>* raw = &block;
+
+#ifdef USE_ZSTD
+    std::vector<uint8_t> unpacked;
+    if (header.codec & GRID_ZSTD)
+    {
+        // Размер из кадра не доверяется: больше, чем дал бы кодек для count значений, не бывает
+        unsigned long long content = ZSTD_getFrameContentSize(block.data(), block.size());
+        size_t limit = count * ((header.codec & GRID_QUANTIZED) ? MAX_VARINT : sizeof(double));
+        if (content == ZSTD_CONTENTSIZE_ERROR || content == ZSTD_CONTENTSIZE_UNKNOWN || content > limit) return false;
+        unpacked.resize(content);
+        size_t size = ZSTD_decompress(unpacked.data(), unpacked.size(), block.data(), block.size());
+        if (ZSTD_isError(size) || size != content) return false;
+        raw = &unpacked;
+    }
+#else
+    if (header.codec & GRID_ZSTD) return false;
+#endif
+
+    if (header.codec & GRID_QUANTIZED)
+    {
+        const double step = 2.0 * header.errorBound;
+        const uint8_t* p = raw->data();
+        const uint8_t* end = p + raw->size();
+        int64_t prev = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t zigzag;
+            if (!getVarint(p, end, zigzag)) return false;
+            prev += int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+            data[i] = prev * step;
+        }
+        return p == end;
+    }
+
+    if (raw->size() != count * sizeof(double)) return false;
+    std::memcpy(data, raw->data(), raw->size());
+    return true;
+}
+
+// Наибольшая степень сжатия zstd: блок кадра - до 128 КБ данных, и даже RLE-блок занимает не меньше 4 байт
+constexpr uint64_t ZSTD_MAX_RATIO = (128 * 1024) / 4;
+
+// Может ли блок размера size на диске дать count значений: без zstd квантованное значение
+// занимает хотя бы байт, сырое - ровно 8; с zstd ещё и размер из заголовка кадра должен сходиться.
+// Так rows * cols ограничено размером файла до выделения памяти под сетку
+inline bool blockFits(int fd, const GridBlock& block, uint64_t count, const GridHeader& header)
+{
+    const bool quantized = header.codec & GRID_QUANTIZED;
+    const uint64_t valueBytes = quantized ? 1 : sizeof(double);
+    if (!(header.codec & GRID_ZSTD))
+    {
+        return quantized ? count <= block.size : block.size % valueBytes == 0 && count == block.size / valueBytes;
+    }
+
+#ifdef USE_ZSTD
+    // Деление вместо умножения: count из заголовка может быть близок к 2^64
+    if (count / ZSTD_MAX_RATIO > block.size / valueBytes) return false;
+    const uint64_t minRaw = count * valueBytes;
+    const uint64_t maxRaw = quantized ? count * MAX_VARINT : minRaw;
+    // Заголовок кадра zstd - не больше 18 байт
+    uint8_t frame[18];
+    size_t frameSize = std::min<uint64_t>(sizeof(frame), block.size);
+    if (pread(fd, frame, frameSize, block.offset) != ssize_t(frameSize)) return false;
+    unsigned long long content = ZSTD_getFrameContentSize(frame, frameSize);
+    return content != ZSTD_CONTENTSIZE_ERROR && content != ZSTD_CONTENTSIZE_UNKNOWN &&
+           content >= minRaw && content <= maxRaw;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+} // namespace grid_detail
+
+// --format: text - как раньше, saveMatrix; grid - без потерь; lossy - с квантованием
+inline bool parseGridFormat(const std::string& format, double errorBound, bool& binary, GridOptions& options)
+{
+    binary = format != "text";
+    options.lossy = format == "lossy";
+    options.errorBound = errorBound;
+    if (format != "text" && format != "grid" && format != "lossy")
+    {
+        std::cerr << "Unknown format: " << format << std::endl;
+        return false;
+    }
+#ifndef USE_ZSTD
+    if (format == "grid")
+    {
+        std::cerr << "The grid format needs libzstd (build with -DUSE_ZSTD -lzstd); use text or lossy" << std::endl;
+        return false;
+    }
+#endif
+    // Шаг квантования 2 * errorBound: при нуле деление на ноль, при отрицательном - знак значений
+    if (!(errorBound > 0.0) || !std::isfinite(errorBound))
+    {
+        std::cerr << "--error-bound must be a positive number" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Сохраняет сетку rows x cols; false при ошибке ввода-вывода
+inline bool saveGrid(const double* data, int rows, int cols, const std::string& filename,
+                     const GridOptions& options = GridOptions())
+{
+    GridHeader header;
+    header.rows = rows;
+    header.cols = cols;
+    header.blockRows = options.blockRows;
+    header.blockCount = (rows + options.blockRows - 1) / options.blockRows;
+    header.codec = (options.lossy ? GRID_QUANTIZED : GRID_RAW);
+    header.errorBound = options.lossy ? options.errorBound : 0.0;
+#ifdef USE_ZSTD
+    header.codec |= GRID_ZSTD;
+#endif
+
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Unable to open file " << filename << " for writing." << std::endl;
+        return false;
+    }
+
+    const int blocks = header.blockCount;
+    std::vector<std::vector<uint8_t>> packed(blocks);
+    std::vector<GridBlock> table(blocks);
+    bool encoded = true;
+    bool ok = true;
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(dynamic)
+        for (int b = 0; b < blocks; b++)
+        {
+            size_t first = size_t(b) * header.blockRows;
+            size_t last = std::min(size_t(rows), first + header.blockRows);
+            if (!grid_detail::encode(data + first * cols, (last - first) * cols,
+                                     header, options.zstdLevel, packed[b]))
+            {
+                #pragma omp atomic write
+                encoded = false;
+            }
+        }
+
+        // Файл с пропущенным блоком не пишется: ошибка кодека не должна давать пустой блок
+        #pragma omp single
+        if (encoded)
+        {
+            uint64_t offset = sizeof(GridHeader) + sizeof(GridBlock) * blocks;
+            for (int b = 0; b < blocks; b++)
+            {
+                table[b] = { offset, packed[b].size() };
+                offset += packed[b].size();
+            }
+            if (pwrite(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)) ||
+                pwrite(fd, table.data(), sizeof(GridBlock) * blocks, sizeof(header)) != ssize_t(sizeof(GridBlock) * blocks))
+            {
+                ok = false;
+            }
+        }
+
+        #pragma omp for schedule(dynamic)
+        for (int b = 0; b < (encoded ? blocks : 0); b++)
+        {
+            if (pwrite(fd, packed[b].data(), packed[b].size(), table[b].offset) != ssize_t(packed[b].size()))
+            {
+                #pragma omp atomic write
+                ok = false;
+            }
+        }
+    }
+
+    close(fd);
+    if (!encoded) unlink(filename.c_str());
+    if (!encoded) std::cerr << "Failed encoding " << filename << ": values out of range or compressor error" << std::endl;
+    else if (!ok) std::cerr << "Failed writing " << filename << std::endl;
+    return encoded && ok;
+}
+
+// Читает сетку, записанную saveGrid
+inline bool loadGrid(const std::string& filename, std::vector<double>& data, GridHeader& header)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Unable to open file " << filename << " for reading." << std::endl;
+        return false;
+    }
+
+    // Заголовок, таблица блоков и размеры блоков сверяются с размером файла до выделения памяти под сетку
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 &&
+              pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)) &&
+              std::memcmp(header.magic, "GRD1", 4) == 0 &&
+              header.blockRows > 0 &&
+              header.blockCount == (uint64_t(header.rows) + header.blockRows - 1) / header.blockRows &&
+              sizeof(header) + sizeof(GridBlock) * uint64_t(header.blockCount) <= uint64_t(st.st_size);
+    std::vector<GridBlock> table(ok ? header.blockCount : 0);
+    ok = ok && pread(fd, table.data(), sizeof(GridBlock) * table.size(), sizeof(header)) == ssize_t(sizeof(GridBlock) * table.size());
+    for (size_t b = 0; ok && b < table.size(); b++)
+    {
+        uint64_t first = b * uint64_t(header.blockRows);
+        uint64_t last = std::min<uint64_t>(header.rows, first + header.blockRows);
+        ok = table[b].offset <= uint64_t(st.st_size) && table[b].size <= uint64_t(st.st_size) - table[b].offset &&
+             grid_detail::blockFits(fd, table[b], (last - first) * header.cols, header);
+    }
+
+    if (ok)
+    {
+        data.resize((size_t)header.rows * header.cols);
+        const int blocks = header.blockCount;
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int b = 0; b < blocks; b++)
+        {
+            std::vector<uint8_t> block(table[b].size);
+            size_t first = size_t(b) * header.blockRows;
+            size_t last = std::min(size_t(header.rows), first + header.blockRows);
+            bool blockOk = pread(fd, block.data(), block.size(), table[b].offset) == ssize_t(block.size()) &&
+                           grid_detail::decode(block, data.data() + first * header.cols,
+                                               (last - first) * header.cols, header);
+            if (!blockOk)
+            {
+                #pragma omp atomic write
+                ok = false;
+            }
+        }
+    }
+
+    close(fd);
+    if (!ok) std::cerr << "File " << filename << " is not a valid grid file." << std::endl;
+    return ok;
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "aligned_buffer.hpp"
+
+// Ленивые векторные выражения (expression templates).
+// Выражение только описывает элемент i - массивы под промежуточные значения
+// не выделяются. Вычисляет его терминальная операция одним проходом:
+//
+//   T s = lazy::sum(lazy::sin(2 * pi * lazy::iota<T>(n) / n));   // без массива
+//   lazy::assign(b, lazy::fill<T>(n, n + 1.0));                   // b[i] = n + 1
+//
+// Терминальные операции:
+//   sum(e), assign(dst, e)   - весь диапазон, параллельно (omp parallel for simd).
+//                               assign внутри параллельной области делит диапазон
+//                               между потоками команды (omp for) и должен вызываться
+//                               всеми её потоками; sum там считается каждым потоком целиком,
+//                               последовательно. sum делит диапазон на SUM_PARTS частей и
+//                               складывает их суммы по порядку, поэтому ответ не зависит
+//                               от числа потоков и одинаков внутри и вне параллельной области.
+//   sum(e, begin, end),      - часть диапазона в текущем потоке (omp simd),
+//   assign(dst, e, begin, end) для своих схем распределения работы.
+// Без OpenMP всё выполняется последовательно.
+
+namespace lazy {
+
+template <class E>
+struct Expr
+{
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+template <class E>
+constexpr bool isExpr = std::is_base_of_v<Expr<E>, E>;
+
+// i-й элемент - T(i)
+template <typename T>
+struct Iota : Expr<Iota<T>>
+{
+    using value_type = T;
+    size_t n;
+
+    size_t size() const { return n; }
+    T operator[](size_t i) const { return T(i); }
+};
+
+// Одно значение на все элементы; без размера, если подставлено в бинарную операцию
+template <typename T>
+struct Scalar : Expr<Scalar<T>>
+{
+    using value_type = T;
+    T value;
+    size_t n = 0;
+
+    size_t size() const { return n; }
+    T operator[](size_t) const { return value; }
+};
+
+// Существующий массив; данные не копируются
+template <typename T>
+struct View : Expr<View<T>>
+{
+    using value_type = T;
+    const T* data;
+    size_t n;
+
+    size_t size() const { return n; }
+    T operator[](size_t i) const { return data[i]; }
+};
+
+template <class Op, class A>
+struct Unary : Expr<Unary<Op, A>>
+{
+    using value_type = typename A::value_type;
+    A a;
+
+    size_t size() const { return a.size(); }
+    value_type operator[](size_t i) const { return Op::apply(a[i]); }
+};
+
+template <class Op, class A, class B>
+struct Binary : Expr<Binary<Op, A, B>>
+{
+    using value_type = decltype(Op::apply(std::declval<typename A::value_type>(), std::declval<typename B::value_type>()));
+    A a;
+    B b;
+
+    size_t size() const { return a.size() ? a.size() : b.size(); }
+    value_type operator[](size_t i) const { return Op::apply(a[i], b[i]); }
+};
+
+template <typename T>
+Iota<T> iota(size_t n) { return { {}, n }; }
+
+template <typename T>
+Scalar<T> fill(size_t n, T value) { return { {}, value, n }; }
+
+template <typename T>
+View<T> view(const T* data, size_t n) { return { {}, data, n }; }
+
+template <typename T>
+View<T> view(const AlignedBuffer<T>& buffer) { return { {}, buffer.get(), buffer.size() }; }
+
+#define LAZY_UNARY(name, expression)                                       \
+    struct name##Op                                                        \
+    {                                                                      \
+        template <typename T> static T apply(T x) { return expression; }   \
+    };                                                                     \
+    template <class E, std::enable_if_t<isExpr<E>, int> = 0>               \
+    Unary<name##Op, E> name(const E& e) { return { {}, e }; }
+
+LAZY_UNARY(sin, std::sin(x))
+LAZY_UNARY(cos, std::cos(x))
+LAZY_UNARY(exp, std::exp(x))
+LAZY_UNARY(sqrt, std::sqrt(x))
+LAZY_UNARY(abs, std::abs(x))
+
+#undef LAZY_UNARY
+
+struct NegateOp
+{
+    template <typename T> static T apply(T x) { return -x; }
+};
+
+template <class E, std::enable_if_t<isExpr<E>, int> = 0>
+Unary<NegateOp, E> operator-(const E& e) { return { {}, e }; }
+
+// Выражение с выражением и выражение с числом; число приводится к типу элементов выражения
+#define LAZY_BINARY(op, name)                                                                  \
+    struct name                                                                                \
+    {                                                                                          \
+        template <typename T> static T apply(T x, T y) { return x op y; }                      \
+    };                                                                                         \
+    template <class A, class B, std::enable_if_t<isExpr<A> && isExpr<B>, int> = 0>             \
+    Binary<name, A, B> operator op(const A& a, const B& b) { return { {}, a, b }; }            \
+    template <class A, typename S, std::enable_if_t<isExpr<A> && std::is_arithmetic_v<S>, int> = 0> \
+    Binary<name, A, Scalar<typename A::value_type>> operator op(const A& a, S s)               \
+    {                                                                                          \
+        return { {}, a, { {}, typename A::value_type(s) } };                                   \
+    }                                                                                          \
+    template <typename S, class B, std::enable_if_t<std::is_arithmetic_v<S> && isExpr<B>, int> = 0> \
+    Binary<name, Scalar<typename B::value_type>, B> operator op(S s, const B& b)               \
+    {                                                                                          \
+        return { {}, { {}, typename B::value_type(s) }, b };                                   \
+    }
+
+LAZY_BINARY(+, AddOp)
+LAZY_BINARY(-, SubOp)
+LAZY_BINARY(*, MulOp)
+LAZY_BINARY(/, DivOp)
+
+#undef LAZY_BINARY
+
+inline bool inParallel()
+{
+#ifdef _OPENMP
+    return omp_in_parallel();
+#else
+    return false;
+#endif
+}
+
+template <class E>
+typename E::value_type sum(const Expr<E>& expr, size_t begin, size_t end)
+{
+    const E& e = expr.self();
+    typename E::value_type s = 0;
+    #pragma omp simd reduction(+:s)
+    for (size_t i = begin; i < end; i++)
+    {
+        s += e[i];
+    }
+    return s;
+}
+
+// Число частей суммы; от него и от n (но не от числа потоков) зависит порядок сложений
+constexpr size_t SUM_PARTS = 256;
+
+template <class E>
+typename E::value_type sum(const Expr<E>& expr)
+{
+    using T = typename E::value_type;
+    const E& e = expr.self();
+    const size_t n = e.size();
+    const size_t part = (n + SUM_PARTS - 1) / SUM_PARTS;
+
+    // Редукция OpenMP складывает частичные суммы потоков в произвольном порядке,
+    // и ответ во float менялся от числа потоков; здесь у каждой части своя сумма
+    // в массиве на стеке. Внутри параллельной области вложенный parallel for
+    // выполнился бы каждым потоком целиком - там те же части считаются последовательно
+    T partial[SUM_PARTS];
+    if (inParallel())
+    {
+        for (size_t p = 0; p < SUM_PARTS; p++)
+        {
+            partial[p] = sum(expr, std::min(n, p * part), std::min(n, (p + 1) * part));
+        }
+    }
+    else
+    {
+        #pragma omp parallel for schedule(static)
+        for (size_t p = 0; p < SUM_PARTS; p++)
+        {
+            partial[p] = sum(expr, std::min(n, p * part), std::min(n, (p + 1) * part));
+        }
+    }
+
+    T s = 0;
+    for (size_t p = 0; p < SUM_PARTS; p++)
+    {
+        s += partial[p];
+    }
+    return s;
+}
+
+template <typename T, class E>
+void assign(T* __restrict dst, const Expr<E>& expr, size_t begin, size_t end)
+{
+    const E& e = expr.self();
+    #pragma omp simd
+    for (size_t i = begin; i < end; i++)
+    {
+        dst[i] = e[i];
+    }
+}
+
+template <typename T, class E>
+void assign(AlignedBuffer<T>& buffer, const Expr<E>& expr)
+{
+    const E& e = expr.self();
+    const size_t n = e.size();
+    T* __restrict dst = buffer.get();
+    if (inParallel())
+    {
+        #pragma omp for simd schedule(static)
+        for (size_t i = 0; i < n; i++)
+        {
+            dst[i] = e[i];
+        }
+        return;
+    }
+    #pragma omp parallel for simd schedule(static)
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] = e[i];
+    }
+}
+
+} // namespace lazy
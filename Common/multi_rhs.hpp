@@ -0,0 +1,207 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "aligned_buffer.hpp"
+
+// Умножение матрицы на k векторов за один проход по матрице (Y = A X).
+// При одном векторе каждый элемент матрицы читается из памяти ради двух операций;
+// с k векторами - ради 2k, и при достаточно большом k ядро упирается уже не в
+// пропускную способность памяти, а в вычисления.
+//
+// Векторы упаковываются построчно: X[j * k + v] - j-я компонента v-го вектора,
+// так что для одного элемента матрицы все k множителей лежат подряд.
+// Разбиение:
+//   - по столбцам на блоки, чтобы панель X (столбцы блока x k) помещалась в L2;
+//   - по строкам на группы из MR строк; по плитке матрицы MR x блок проходят все
+//     панели из NR векторов. Плитка занимает MR / k от половины L2 (512 КБ при k = 1,
+//     16 КБ при k = 32), так что в L1 она остаётся только при больших k; при k <= NR
+//     панель одна и матрица читается из памяти ровно один раз, в промежутке
+//     повторные проходы берут плитку из L2;
+//   - микроядро MR x NR держит суммы в регистрах; остаток векторов - панелью
+//     NR / 2 и скалярными произведениями по одному вектору.
+
+constexpr int MULTI_RHS_MR = 4;
+constexpr int MULTI_RHS_NR = 8;
+constexpr size_t MULTI_RHS_L2 = size_t(256) << 10;
+
+// Ширина блока столбцов: панель X занимает около половины L2
+template <typename T>
+int multiRhsColumnBlock(int n, int k)
+{
+    size_t columns = MULTI_RHS_L2 / 2 / (sizeof(T) * size_t(k));
+    columns = std::max<size_t>(columns / MULTI_RHS_NR * MULTI_RHS_NR, 64);
+    return int(std::min<size_t>(columns, size_t(n)));
+}
+
+// Y[row * k + v] += сумма по столбцам [j0, j1) строк [row, row + MR) на векторы [v0, v0 + NR)
+template <int MR, int NR, typename T>
+inline void multiRhsMicroKernel(const T* __restrict A, const T* __restrict X, T* __restrict Y,
+                                int n, int k, int row, int v0, int j0, int j1)
+{
+    T acc[MR][NR] = {};
+    const T* rows[MR];
+    for (int r = 0; r < MR; r++)
+    {
+        rows[r] = A + size_t(row + r) * n;
+    }
+
+    for (int j = j0; j < j1; j++)
+    {
+        const T* x = X + size_t(j) * k + v0;
+        for (int r = 0; r < MR; r++)
+        {
+            const T a = rows[r][j];
+            #pragma omp simd
+            for (int v = 0; v < NR; v++)
+            {
+                acc[r][v] += a * x[v];
+            }
+        }
+    }
+
+    for (int r = 0; r < MR; r++)
+    {
+        T* y = Y + size_t(row + r) * k + v0;
+        for (int v = 0; v < NR; v++)
+        {
+            y[v] += acc[r][v];
+        }
+    }
+}
+
+// Остаток векторов по одному: MR скалярных произведений, векторизованных по столбцам
+template <int MR, typename T>
+inline void multiRhsDotKernel(const T* __restrict A, const T* __restrict X, T* __restrict Y,
+                              int n, int k, int row, int v, int j0, int j1)
+{
+    T acc[MR] = {};
+    for (int r = 0; r < MR; r++)
+    {
+        const T* a = A + size_t(row + r) * n;
+        T sum = 0;
+        #pragma omp simd reduction(+:sum)
+        for (int j = j0; j < j1; j++)
+        {
+            sum += a[j] * X[size_t(j) * k + v];
+        }
+        acc[r] = sum;
+    }
+    for (int r = 0; r < MR; r++)
+    {
+        Y[size_t(row + r) * k + v] += acc[r];
+    }
+}
+
+// Строки [rowStart, rowEnd) результата; Y этих строк перезаписывается
+template <typename T>
+void multiRhsRows(const T* A, const T* X, T* Y, int n, int k, int rowStart, int rowEnd)
+{
+    std::fill(Y + size_t(rowStart) * k, Y + size_t(rowEnd) * k, T(0));
+
+    const int block = multiRhsColumnBlock<T>(n, k);
+    const int rowsMain = rowStart + (rowEnd - rowStart) / MULTI_RHS_MR * MULTI_RHS_MR;
+    const int vectorsMain = k / MULTI_RHS_NR * MULTI_RHS_NR;
+
+    for (int j0 = 0; j0 < n; j0 += block)
+    {
+        const int j1 = std::min(j0 + block, n);
+        for (int row = rowStart; row < rowEnd; )
+        {
+            const bool full = row < rowsMain;
+            int v = 0;
+            if (full)
+            {
+                for (; v < vectorsMain; v += MULTI_RHS_NR)
+                {
+                    multiRhsMicroKernel<MULTI_RHS_MR, MULTI_RHS_NR>(A, X, Y, n, k, row, v, j0, j1);
+                }
+                for (; v + MULTI_RHS_NR / 2 <= k; v += MULTI_RHS_NR / 2)
+                {
+                    multiRhsMicroKernel<MULTI_RHS_MR, MULTI_RHS_NR / 2>(A, X, Y, n, k, row, v, j0, j1);
+                }
+                for (; v < k; v++)
+                {
+                    multiRhsDotKernel<MULTI_RHS_MR>(A, X, Y, n, k, row, v, j0, j1);
+                }
+                row += MULTI_RHS_MR;
+            }
+            else
+            {
+                for (; v < vectorsMain; v += MULTI_RHS_NR)
+                {
+                    multiRhsMicroKernel<1, MULTI_RHS_NR>(A, X, Y, n, k, row, v, j0, j1);
+                }
+                for (; v + MULTI_RHS_NR / 2 <= k; v += MULTI_RHS_NR / 2)
+                {
+                    multiRhsMicroKernel<1, MULTI_RHS_NR / 2>(A, X, Y, n, k, row, v, j0, j1);
+                }
+                for (; v < k; v++)
+                {
+                    multiRhsDotKernel<1>(A, X, Y, n, k, row, v, j0, j1);
+                }
+                row++;
+            }
+        }
+    }
+}
+
+// Упаковка k векторов длины n (vectors[v * n + j]) в X[j * k + v]
+template <typename T>
+void packRhs(const T* vectors, T* X, int n, int k, int rowStart, int rowEnd)
+{
+    for (int j = rowStart; j < rowEnd; j++)
+    {
+        for (int v = 0; v < k; v++)
+        {
+            X[size_t(j) * k + v] = vectors[size_t(v) * n + j];
+        }
+    }
+}
+
+// Тестовые векторы x_v[j] = j + 1 + v. Матрица задач - 2 на диагонали и 1 вне её,
+// поэтому y_v[i] = sum_j x_v[j] + x_v[i] = n (n + 1) / 2 + n v + i + 1 + v
+template <typename T>
+double multiRhsMaxError(const T* Y, int n, int k)
+{
+    double error = 0;
+    for (int i = 0; i < n; i++)
+    {
+        for (int v = 0; v < k; v++)
+        {
+            double expected = 0.5 * n * (n + 1.0) + double(n) * v + i + 1.0 + v;
+            error = std::max(error, std::fabs(Y[size_t(i) * k + v] - expected) / expected);
+        }
+    }
+    return error;
+}
+
+// Таблица по числу векторов; выигрыш - пропускная способность (векторов в секунду)
+// относительно первого запуска
+class MultiRhsReport
+{
+public:
+    explicit MultiRhsReport(int numThreads, int size)
+    {
+        std::cout << "Multi-RHS: Threads: " << numThreads << "\tSize: " << size << std::endl;
+    }
+
+    void add(int k, int size, double seconds, double error)
+    {
+        double perVector = seconds / k;
+        if (basePerVector_ < 0) basePerVector_ = perVector;
+
+        std::cout << "RHS: " << k
+                  << "\tThe time: " << seconds * 1000.0 << " ms"
+                  << "\tPer vector: " << perVector * 1000.0 << " ms"
+                  << "\tGFLOP/s: " << 2.0 * size * size * k / seconds / 1e9
+                  << "\tGain: " << basePerVector_ / perVector
+                  << "\tMax rel. error: " << error << std::endl;
+    }
+
+private:
+    double basePerVector_ = -1;
+};
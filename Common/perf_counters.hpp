@@ -0,0 +1,358 @@
+#pragma once
+
+// Аппаратные счётчики (perf_event_open) вокруг вычислительных ядер.
+// Без -DPERF_COUNTERS макросы раскрываются в пустоту.
+//
+//   PERF_KERNEL("sweep", bytes, flops);  - до конца блока; bytes и flops - модель ядра
+//                                          за один вызов (минимальный трафик памяти и
+//                                          число операций с плавающей точкой)
+//   PERF_REPORT();                        - таблица по ядрам в конце main
+//
+// По модели считаются достигнутые GB/s, GFLOP/s и арифметическая интенсивность
+// (flop/byte), по счётчикам - IPC и трафик промахов LLC (64 байта на промах).
+// Положение на roofline: ridge = peak GFLOP/s / peak GB/s; ядра с интенсивностью
+// ниже ridge упираются в память, выше - в вычисления. Пики берутся из
+// PERF_PEAK_GBS и PERF_PEAK_GFLOPS, иначе один раз измеряются (triad и FMA).
+//
+// Вне параллельной области счётчики читаются во всех потоках команды OpenMP
+// (отдельной parallel-областью), внутри неё - каждый поток считает свою часть.
+// Потоки std::thread, завершившиеся внутри блока, учитываются через inherit.
+// Если счётчик недоступен (виртуальная машина, perf_event_paranoid), в таблице "-".
+
+#ifdef PERF_COUNTERS
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace perf {
+
+enum Counter { CYCLES, INSTRUCTIONS, LLC_MISSES, COUNTERS };
+
+struct Values
+{
+    uint64_t v[COUNTERS] = {};
+};
+
+// Счётчики текущего потока; открываются при первом обращении
+class ThreadCounters {
+public:
+    static ThreadCounters& local()
+    {
+        thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    ~ThreadCounters()
+    {
+        for (int fd : fd_)
+        {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    Values read() const
+    {
+        Values values;
+        for (int i = 0; i < COUNTERS; i++)
+        {
+            // value, time_enabled, time_running - поправка на мультиплексирование
+            uint64_t data[3];
+            if (fd_[i] >= 0 && ::read(fd_[i], data, sizeof(data)) == ssize_t(sizeof(data)) && data[2] > 0)
+            {
+                values.v[i] = uint64_t(double(data[0]) * data[1] / data[2]);
+            }
+        }
+        return values;
+    }
+
+    bool available(int counter) const { return fd_[counter] >= 0; }
+
+private:
+    int fd_[COUNTERS];
+
+    ThreadCounters()
+    {
+        const uint64_t configs[COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+        for (int i = 0; i < COUNTERS; i++)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.inherit = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fd_[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+    }
+};
+
+struct KernelStats
+{
+    long long calls = 0;
+    double seconds = 0;
+    double bytes = 0;
+    double flops = 0;
+    Values counters;
+    bool available[COUNTERS] = {};
+};
+
+class Registry {
+public:
+    static Registry& instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    void addCall(const char* name, double seconds, double bytes, double flops)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        KernelStats& stats = kernels_[name];
+        stats.calls++;
+        stats.seconds += seconds;
+        stats.bytes += bytes;
+        stats.flops += flops;
+    }
+
+    void addCounters(const char* name, const Values& begin, const Values& end, const ThreadCounters& source)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        KernelStats& stats = kernels_[name];
+        for (int i = 0; i < COUNTERS; i++)
+        {
+            stats.counters.v[i] += end.v[i] - begin.v[i];
+            stats.available[i] = stats.available[i] || source.available(i);
+        }
+    }
+
+    void report();
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, KernelStats> kernels_;
+};
+
+inline int teamSize()
+{
+#ifdef _OPENMP
+    return omp_in_parallel() ? 1 : omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+inline bool inParallel()
+{
+#ifdef _OPENMP
+    return omp_in_parallel();
+#else
+    return false;
+#endif
+}
+
+inline bool isMaster()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num() == 0;
+#else
+    return true;
+#endif
+}
+
+class Kernel {
+public:
+    Kernel(const char* name, double bytes, double flops)
+        : name_(name), bytes_(bytes), flops_(flops), nested_(inParallel()),
+          start_(std::chrono::steady_clock::now())
+    {
+        if (nested_)
+        {
+            begin_.assign(1, ThreadCounters::local().read());
+            return;
+        }
+        begin_.resize(teamSize());
+        #pragma omp parallel num_threads(int(begin_.size()))
+        {
+            begin_[thread()] = ThreadCounters::local().read();
+        }
+    }
+
+    ~Kernel()
+    {
+        Registry& registry = Registry::instance();
+        if (nested_)
+        {
+            ThreadCounters& counters = ThreadCounters::local();
+            registry.addCounters(name_, begin_[0], counters.read(), counters);
+        }
+        else
+        {
+            #pragma omp parallel num_threads(int(begin_.size()))
+            {
+                ThreadCounters& counters = ThreadCounters::local();
+                registry.addCounters(name_, begin_[thread()], counters.read(), counters);
+            }
+        }
+
+        // Время и модель - один раз на вызов
+        if (isMaster())
+        {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+            registry.addCall(name_, seconds, bytes_, flops_);
+        }
+    }
+
+    Kernel(const Kernel&) = delete;
+    Kernel& operator=(const Kernel&) = delete;
+
+private:
+    const char* name_;
+    double bytes_;
+    double flops_;
+    bool nested_;
+    std::chrono::steady_clock::time_point start_;
+    std::vector<Values> begin_;
+
+    static int thread()
+    {
+#ifdef _OPENMP
+        return omp_get_thread_num();
+#else
+        return 0;
+#endif
+    }
+};
+
+// Не даёт компилятору выбросить измерительные циклы
+inline volatile double sink;
+
+// Пропускная способность памяти: triad a = b + s * c на массивах больше LLC
+inline double measurePeakBandwidth()
+{
+    const size_t n = size_t(1) << 24;
+    std::vector<double> a(n), b(n, 1.0), c(n, 2.0);
+    double best = 0;
+    for (int repeat = 0; repeat < 3; repeat++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; i++)
+        {
+            a[i] = b[i] + 3.0 * c[i];
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, 3.0 * n * sizeof(double) / seconds / 1e9);
+    }
+    sink = a[n / 2];
+    return best;
+}
+
+// Пиковая производительность: независимые цепочки FMA в регистрах
+inline double measurePeakFlops()
+{
+    const int chains = 32;
+    const long long steps = 1 << 22;
+    double best = 0;
+    for (int repeat = 0; repeat < 3; repeat++)
+    {
+        double sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        #pragma omp parallel reduction(+:sum)
+        {
+            double x[chains];
+            for (int k = 0; k < chains; k++) x[k] = 1.0 + k * 1e-9;
+            for (long long s = 0; s < steps; s++)
+            {
+                #pragma omp simd
+                for (int k = 0; k < chains; k++)
+                {
+                    x[k] = x[k] * 0.999999 + 1e-7;
+                }
+            }
+            for (int k = 0; k < chains; k++) sum += x[k];
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, 2.0 * chains * steps * teamSize() / seconds / 1e9);
+        sink = sum;
+    }
+    return best;
+}
+
+inline void Registry::report()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (kernels_.empty()) return;
+
+    const char* gbsEnv = std::getenv("PERF_PEAK_GBS");
+    const char* flopsEnv = std::getenv("PERF_PEAK_GFLOPS");
+    double peakGbs = gbsEnv ? std::atof(gbsEnv) : measurePeakBandwidth();
+    double peakGflops = flopsEnv ? std::atof(flopsEnv) : measurePeakFlops();
+    double ridge = peakGflops / peakGbs;
+
+    std::cout << "Kernel counters (peak " << peakGbs << " GB/s, " << peakGflops
+              << " GFLOP/s, ridge " << ridge << " flop/byte):" << std::endl;
+
+    auto column = [](bool ok, double value) {
+        std::ostringstream out;
+        if (ok) out << std::setprecision(3) << value;
+        else out << '-';
+        return out.str();
+    };
+
+    std::cout << std::left << '\t' << std::setw(16) << "kernel" << std::right
+              << std::setw(8) << "calls" << std::setw(10) << "time s"
+              << std::setw(10) << "GB/s" << std::setw(10) << "GFLOP/s" << std::setw(8) << "AI"
+              << std::setw(8) << "IPC" << std::setw(10) << "LLC GB/s" << "  roofline" << std::endl;
+
+    for (auto& [name, k] : kernels_)
+    {
+        double gbs = k.bytes / k.seconds / 1e9;
+        double gflops = k.flops / k.seconds / 1e9;
+        double intensity = k.bytes > 0 ? k.flops / k.bytes : 0;
+        double attainable = std::min(peakGflops, intensity * peakGbs);
+        bool cycles = k.available[CYCLES] && k.counters.v[CYCLES] > 0;
+
+        std::cout << std::left << '\t' << std::setw(16) << name << std::right
+                  << std::setw(8) << k.calls << std::setw(10) << std::setprecision(4) << k.seconds
+                  << std::setw(10) << column(true, gbs) << std::setw(10) << column(true, gflops)
+                  << std::setw(8) << column(true, intensity)
+                  << std::setw(8) << column(cycles, double(k.counters.v[INSTRUCTIONS]) / k.counters.v[CYCLES])
+                  << std::setw(10) << column(k.available[LLC_MISSES], k.counters.v[LLC_MISSES] * 64.0 / k.seconds / 1e9)
+                  << "  " << (intensity < ridge ? "memory" : "compute") << "-bound, "
+                  << std::setprecision(3) << 100.0 * gflops / attainable << "% of attainable" << std::endl;
+    }
+}
+
+} // namespace perf
+
+#define PERF_CONCAT_(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+#define PERF_KERNEL(name, bytes, flops) ::perf::Kernel PERF_CONCAT(perfKernel_, __LINE__)(name, double(bytes), double(flops))
+#define PERF_REPORT() ::perf::Registry::instance().report()
+
+#else
+
+// Аргументы вычисляются и отбрасываются: переменные модели ядра не считаются неиспользуемыми
+#define PERF_KERNEL(name, bytes, flops) ((void)(name), (void)(bytes), (void)(flops))
+#define PERF_REPORT() ((void)0)
+
+#endif
@@ -0,0 +1,300 @@
+#pragma once
+
+// Разметка горячих участков: именованные интервалы и счётчики.
+// Без -DPROFILE, -DUSE_NVTX и -DUSE_ITT все макросы раскрываются в пустоту и ничего не стоят.
+// С -DPROFILE события копятся в буферах потоков, PROFILE_REPORT() в конце main
+// печатает сводку по фазам и пишет трассу в формате Chrome trace
+// (chrome://tracing, Perfetto) в файл из PROFILE_TRACE (по умолчанию trace.json).
+// Дополнительно интервалы пересылаются в NVTX (-DUSE_NVTX) или ITT (-DUSE_ITT);
+// с ними, но без -DPROFILE, интервалы уходят только во внешний профилировщик,
+// без буферов, сводки и трассы.
+//
+//   PROFILE_RANGE("sweep");            - интервал до конца текущего блока
+//   PROFILE_COUNTER("error", error);   - значение счётчика в текущий момент
+//   PROFILE_REPORT();                  - сводка и запись трассы
+//
+// Имена должны быть строковыми литералами: хранится только указатель.
+// PROFILE_REPORT() можно вызывать, пока другие потоки ещё пишут события
+// (пул OpenMP, поток SnapshotWriter, рабочие потоки сервера): буфер каждого потока
+// под своим мьютексом, в отчёт попадает то, что записано до его вызова.
+// Для асинхронных ядер (acc async, CUDA) интервал - время постановки в очередь,
+// а не выполнения; на CPU-сборках это время самой фазы.
+
+#if defined(PROFILE) || defined(USE_NVTX) || defined(USE_ITT)
+
+#ifdef USE_NVTX
+#include <nvtx3/nvToolsExt.h>
+#endif
+#ifdef USE_ITT
+#include <ittnotify.h>
+#endif
+
+namespace profile {
+
+// Статическая точка разметки: имя и описатели внешних профилировщиков создаются один раз
+struct Site
+{
+    const char* name;
+#ifdef USE_ITT
+    __itt_string_handle* handle;
+#endif
+
+    explicit Site(const char* n) : name(n)
+    {
+#ifdef USE_ITT
+        handle = __itt_string_handle_create(n);
+#endif
+    }
+};
+
+#ifdef USE_ITT
+inline __itt_domain* ittDomain()
+{
+    static __itt_domain* domain = __itt_domain_create("solver");
+    return domain;
+}
+#endif
+
+// Интервал во внешних профилировщиках; без них ничего не делает
+inline void markBegin([[maybe_unused]] const Site& site)
+{
+#ifdef USE_NVTX
+    nvtxRangePushA(site.name);
+#endif
+#ifdef USE_ITT
+    __itt_task_begin(ittDomain(), __itt_null, __itt_null, site.handle);
+#endif
+}
+
+inline void markEnd()
+{
+#ifdef USE_ITT
+    __itt_task_end(ittDomain());
+#endif
+#ifdef USE_NVTX
+    nvtxRangePop();
+#endif
+}
+
+} // namespace profile
+
+#endif
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILE
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace profile {
+
+using Clock = std::chrono::steady_clock;
+
+struct Event
+{
+    const char* name;
+    long long start;    // мкс от запуска
+    long long duration; // мкс; для счётчика не используется
+    double value;       // значение счётчика
+    bool counter;
+};
+
+// Буфер одного потока. Пишет в него только владелец, поэтому мьютекс почти всегда
+// свободен; нужен он для report, который читает буферы из другого потока
+struct ThreadLog
+{
+    int tid;
+    std::mutex mutex;
+    std::vector<Event> events;
+
+    void add(const Event& e)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(e);
+    }
+
+    std::vector<Event> snapshot()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return events;
+    }
+};
+
+class Recorder {
+public:
+    static Recorder& instance()
+    {
+        static Recorder recorder;
+        return recorder;
+    }
+
+    long long now() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - origin_).count();
+    }
+
+    // Буфер текущего потока; регистрируется один раз под общим мьютексом
+    ThreadLog& log()
+    {
+        thread_local ThreadLog* local = nullptr;
+        if (!local)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            logs_.push_back(std::make_unique<ThreadLog>());
+            local = logs_.back().get();
+            local->tid = int(logs_.size()) - 1;
+            local->events.reserve(1 << 12);
+        }
+        return *local;
+    }
+
+    void report()
+    {
+        // Копии буферов: потоки, которые ещё работают, продолжают писать в свои
+        std::vector<std::vector<Event>> events;
+        std::vector<int> tids;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& log : logs_)
+            {
+                events.push_back(log->snapshot());
+                tids.push_back(log->tid);
+            }
+        }
+
+        struct Total { long long count = 0; long long us = 0; };
+        std::map<std::string, Total> totals;
+        for (const auto& log : events)
+        {
+            for (const Event& e : log)
+            {
+                if (e.counter) continue;
+                Total& t = totals[e.name];
+                t.count++;
+                t.us += e.duration;
+            }
+        }
+
+        std::cout << "Profile:" << std::endl;
+        for (auto& [name, t] : totals)
+        {
+            std::cout << '\t' << std::left << std::setw(16) << name << std::right
+                      << std::setw(10) << t.count << " calls "
+                      << std::setw(12) << t.us * 1e-6 << " s" << std::endl;
+        }
+
+        const char* env = std::getenv("PROFILE_TRACE");
+        std::string filename = env ? env : "trace.json";
+        std::ofstream out(filename);
+        if (!out.is_open())
+        {
+            std::cerr << "Unable to open file " << filename << " for writing." << std::endl;
+            return;
+        }
+
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (size_t t = 0; t < events.size(); t++)
+        {
+            for (const Event& e : events[t])
+            {
+                out << (first ? "" : ",\n");
+                first = false;
+                if (e.counter)
+                {
+                    out << "{\"name\":\"" << e.name << "\",\"ph\":\"C\",\"ts\":" << e.start
+                        << ",\"pid\":0,\"tid\":" << tids[t] << ",\"args\":{\"value\":" << e.value << "}}";
+                }
+                else
+                {
+                    out << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"ts\":" << e.start
+                        << ",\"dur\":" << e.duration << ",\"pid\":0,\"tid\":" << tids[t] << "}";
+                }
+            }
+        }
+        out << "\n]}\n";
+        std::cout << "Trace: " << filename << std::endl;
+    }
+
+private:
+    Clock::time_point origin_ = Clock::now();
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadLog>> logs_;
+};
+
+class Range {
+public:
+    explicit Range(const Site& site) : site_(site), start_(Recorder::instance().now())
+    {
+        markBegin(site);
+    }
+
+    ~Range()
+    {
+        markEnd();
+        Recorder& recorder = Recorder::instance();
+        recorder.log().add({ site_.name, start_, recorder.now() - start_, 0.0, false });
+    }
+
+    Range(const Range&) = delete;
+    Range& operator=(const Range&) = delete;
+
+private:
+    const Site& site_;
+    long long start_;
+};
+
+inline void counter(const char* name, double value)
+{
+    Recorder& recorder = Recorder::instance();
+    recorder.log().add({ name, recorder.now(), 0, value, true });
+}
+
+} // namespace profile
+
+#define PROFILE_RANGE(name) \
+    static const ::profile::Site PROFILE_CONCAT(profileSite_, __LINE__)(name); \
+    ::profile::Range PROFILE_CONCAT(profileRange_, __LINE__)(PROFILE_CONCAT(profileSite_, __LINE__))
+#define PROFILE_COUNTER(name, value) ::profile::counter(name, double(value))
+#define PROFILE_REPORT() ::profile::Recorder::instance().report()
+
+#elif defined(USE_NVTX) || defined(USE_ITT)
+
+namespace profile {
+
+class Marker {
+public:
+    explicit Marker(const Site& site) { markBegin(site); }
+    ~Marker() { markEnd(); }
+
+    Marker(const Marker&) = delete;
+    Marker& operator=(const Marker&) = delete;
+};
+
+} // namespace profile
+
+#define PROFILE_RANGE(name) \
+    static const ::profile::Site PROFILE_CONCAT(profileSite_, __LINE__)(name); \
+    ::profile::Marker PROFILE_CONCAT(profileRange_, __LINE__)(PROFILE_CONCAT(profileSite_, __LINE__))
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_REPORT() ((void)0)
+
+#else
+
+#define PROFILE_RANGE(name) ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_REPORT() ((void)0)
+
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <omp.h>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+// Общие параметры запуска: размер задачи, число потоков, точность и расписание.
+// Позволяют провести сильное/слабое масштабирование одним бинарником без пересборки.
+struct RunConfig
+{
+    int size = 0;
+    std::vector<int> threads;
+    std::string precision = "double";
+    std::string schedule = "static";
+    int chunk = 0;
+    bool weak = false;
+
+    // При слабом масштабировании объём работы на поток постоянен:
+    // работа ~ size^workExponent, поэтому size растёт как threads^(1/workExponent)
+    int scaledSize(int numThreads, int workExponent) const
+    {
+        if (!weak) return size;
+        return int(std::lround(size * std::pow(double(numThreads), 1.0 / workExponent)));
+    }
+
+    // Настраивает расписание для циклов с schedule(runtime)
+    bool applySchedule() const
+    {
+        omp_sched_t kind;
+        if (schedule == "static") kind = omp_sched_static;
+        else if (schedule == "dynamic") kind = omp_sched_dynamic;
+        else if (schedule == "guided") kind = omp_sched_guided;
+        else
+        {
+            std::cerr << "Unknown schedule: " << schedule << std::endl;
+            return false;
+        }
+        omp_set_schedule(kind, chunk);
+        return true;
+    }
+};
+
+inline void addRunOptions(po::options_description& desc, RunConfig& config, int defaultSize, int defaultThreads)
+{
+    desc.add_options()
+        ("size", po::value<int>(&config.size)->default_value(defaultSize), "Problem size")
+        ("threads", po::value<std::vector<int>>(&config.threads)->multitoken()
+            ->default_value(std::vector<int>{defaultThreads}, std::to_string(defaultThreads)),
+            "Thread counts to sweep, e.g. --threads 1 2 4 8")
+        ("precision", po::value<std::string>(&config.precision)->default_value("double"), "float or double")
+        ("schedule", po::value<std::string>(&config.schedule)->default_value("static"), "static, dynamic or guided")
+        ("chunk", po::value<int>(&config.chunk)->default_value(0), "Schedule chunk size (0 - default)")
+        ("weak", po::bool_switch(&config.weak), "Weak scaling: grow size with the thread count")
+        ("help", "Show all command")
+    ;
+}
+
+// Разбирает командную строку, возвращает false, если программу нужно завершить
+inline bool parseRunOptions(int argc, char const* argv[], po::options_description& desc, po::variables_map& vm)
+{
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Вызывает run.template operator()<T>() для выбранной точности
+template <class F>
+int dispatchPrecision(const RunConfig& config, F&& run)
+{
+    if (config.precision == "float") return run.template operator()<float>();
+    if (config.precision == "double") return run.template operator()<double>();
+
+    std::cerr << "Unknown precision: " << config.precision << std::endl;
+    return 1;
+}
+
+// Печатает строку таблицы масштабирования; ускорение считается относительно первого запуска
+class ScalingReport
+{
+public:
+    explicit ScalingReport(const RunConfig& config) : weak_(config.weak)
+    {
+        std::cout << "Precision: " << config.precision
+                  << "\tSchedule: " << config.schedule << ", " << config.chunk
+                  << "\tScaling: " << (weak_ ? "weak" : "strong") << std::endl;
+    }
+
+    void add(int numThreads, int size, double seconds)
+    {
+        if (baseTime_ < 0)
+        {
+            baseTime_ = seconds;
+            baseThreads_ = numThreads;
+        }
+
+        // Для слабого масштабирования идеальное время постоянно
+        double speedup = baseTime_ / seconds;
+        double efficiency = weak_ ? speedup : speedup * baseThreads_ / numThreads;
+
+        std::cout << "Threads: " << numThreads
+                  << "\tSize: " << size
+                  << "\tThe time: " << seconds * 1000.0 << " ms"
+                  << "\tSpeedup: " << speedup
+                  << "\tEfficiency: " << efficiency << std::endl;
+    }
+
+private:
+    bool weak_;
+    double baseTime_ = -1;
+    int baseThreads_ = 1;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <queue>
+
+#include "aligned_buffer.hpp"
+
+// Пишет кадры сетки в фоновом потоке. Два буфера: пока один записывается,
+// вычислительный поток копирует следующий кадр во второй. Если оба заняты,
+// submit ждёт освобождения буфера - запрошенные кадры не теряются.
+// С dropWhenBusy кадр вместо этого пропускается и учитывается в dropped():
+// вычисления тогда никогда не ждут ввода-вывода.
+class SnapshotWriter {
+public:
+    using WriteFn = std::function<void(const double*, int, const std::string&)>;
+
+    SnapshotWriter(int size, size_t length, std::string prefix, std::string extension, WriteFn write,
+                   bool dropWhenBusy = false)
+        : size_(size), len_(length), prefix_(std::move(prefix)), extension_(std::move(extension)), write_(std::move(write)),
+          dropWhenBusy_(dropWhenBusy)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            buffers_[i] = AlignedBuffer<double>(length);
+        }
+        thread_ = std::thread(&SnapshotWriter::run, this);
+    }
+
+    ~SnapshotWriter() { finish(); }
+
+    // Дожидается записи всех кадров из очереди
+    void finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Копирует кадр и ставит его в очередь; false - кадр пропущен (только с dropWhenBusy)
+    bool submit(const double* grid, int step)
+    {
+        int slot = -1;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (dropWhenBusy_ && busy_[0] && busy_[1])
+            {
+                dropped_++;
+                return false;
+            }
+            freed_.wait(lock, [this] { return !busy_[0] || !busy_[1]; });
+            slot = busy_[0] ? 1 : 0;
+            busy_[slot] = true;
+        }
+
+        std::memcpy(buffers_[slot].get(), grid, len_ * sizeof(double));
+        steps_[slot] = step;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push(slot);
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    // Точные значения - после finish()
+    int written() const { return written_; }
+    int dropped() const { return dropped_; }
+
+private:
+    int size_;
+    size_t len_;
+    std::string prefix_;
+    std::string extension_;
+    WriteFn write_;
+    bool dropWhenBusy_;
+
+    AlignedBuffer<double> buffers_[2];
+    int steps_[2] = { 0, 0 };
+    bool busy_[2] = { false, false };
+    std::queue<int> queue_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable freed_;
+    std::thread thread_;
+    bool stop_ = false;
+    int written_ = 0;
+    int dropped_ = 0;
+
+    void run()
+    {
+        while (true)
+        {
+            int slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty()) return; // stop_ и все кадры записаны
+                slot = queue_.front();
+                queue_.pop();
+            }
+
+            char name[32];
+            std::snprintf(name, sizeof(name), "_%06d", steps_[slot]);
+            write_(buffers_[slot].get(), size_, prefix_ + name + extension_);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                busy_[slot] = false;
+                written_++;
+            }
+            freed_.notify_one();
+        }
+    }
+};
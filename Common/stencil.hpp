@@ -0,0 +1,255 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <boost/program_options.hpp>
+
+#include "profile.hpp"
+#include "perf_counters.hpp"
+
+// Шаблон и граничные условия задачи -div(k grad u) = f на сетке size x size.
+// Внешнее кольцо сетки - граница: при Dirichlet оно неизменно,
+// при Neumann (нулевой поток) и Periodic пересчитывается после каждого шага.
+//
+// Описание задаётся при запуске, но шаг Якоби специализирован шаблоном по виду
+// шаблона и наличию источника: выбор делается один раз на итерацию,
+// а внутренний цикл остаётся таким же, как рукописный 5-точечный.
+
+enum class Stencil { Five, Nine, Variable };
+enum class Boundary { Dirichlet, Neumann, Periodic };
+
+struct StencilConfig
+{
+    Stencil stencil = Stencil::Five;
+    Boundary boundary = Boundary::Dirichlet;
+    double source = 0.0;        // f, постоянная правая часть
+    std::string boundaryFile;   // значения Дирихле: матрица size x size, берётся её кольцо
+    std::string coeffFile;      // k(x, y) для Variable: матрица size x size
+
+    bool hasSource() const { return source != 0.0; }
+};
+
+inline void addStencilOptions(boost::program_options::options_description& desc)
+{
+    namespace po = boost::program_options;
+    desc.add_options()
+        ("stencil", po::value<std::string>()->default_value("5"),"Stencil: 5, 9 or var")
+        ("boundary", po::value<std::string>()->default_value("dirichlet"),"Boundary: dirichlet, neumann or periodic")
+        ("boundary-file", po::value<std::string>()->default_value(""),"Dirichlet values (matrix file, edges are used)")
+        ("coeff-file", po::value<std::string>()->default_value(""),"Conductivity k(x, y) for --stencil var")
+        ("source", po::value<double>()->default_value(0.0),"Constant source term f")
+    ;
+}
+
+inline bool readStencilConfig(const boost::program_options::variables_map& vm, StencilConfig& config)
+{
+    std::string stencil = vm["stencil"].as<std::string>();
+    if (stencil == "5") config.stencil = Stencil::Five;
+    else if (stencil == "9") config.stencil = Stencil::Nine;
+    else if (stencil == "var") config.stencil = Stencil::Variable;
+    else
+    {
+        std::cerr << "Unknown stencil: " << stencil << std::endl;
+        return false;
+    }
+
+    std::string boundary = vm["boundary"].as<std::string>();
+    if (boundary == "dirichlet") config.boundary = Boundary::Dirichlet;
+    else if (boundary == "neumann") config.boundary = Boundary::Neumann;
+    else if (boundary == "periodic") config.boundary = Boundary::Periodic;
+    else
+    {
+        std::cerr << "Unknown boundary: " << boundary << std::endl;
+        return false;
+    }
+
+    config.boundaryFile = vm["boundary-file"].as<std::string>();
+    config.coeffFile = vm["coeff-file"].as<std::string>();
+    config.source = vm["source"].as<double>();
+    return true;
+}
+
+// Читает матрицу size x size в формате saveMatrix
+inline bool readMatrix(const std::string& filename, double* arr, int size)
+{
+    std::ifstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "Unable to open file " << filename << " for reading." << std::endl;
+        return false;
+    }
+
+    for (long long i = 0; i < (long long)size * size; i++)
+    {
+        if (!(file >> arr[i]))
+        {
+            std::cerr << "File " << filename << " has less than " << size << 'x' << size << " values." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Края - линейная интерполяция между угловыми значениями
+inline void initCornerBoundary(double* arr, int size, double leftUp, double rightUp, double leftDown, double rightDown)
+{
+    arr[0] = leftUp;
+    arr[size - 1] = rightUp;
+    arr[(size - 1) * size] = leftDown;
+    arr[(size - 1) * size + size - 1] = rightDown;
+
+    for (int i = 1; i < size - 1; i++)
+    {
+        arr[i] = (rightUp - leftUp) / (size - 1) * i + leftUp;
+        arr[i * size] = (leftDown - leftUp) / (size - 1) * i + leftUp;
+
+        arr[(size - 1) * size + i] = (rightDown - leftDown) / (size - 1) * i + leftDown;
+        arr[i * size + size - 1] = (rightDown - rightUp) / (size - 1) * i + rightUp;
+    }
+}
+
+// Копирует кольцо граничных значений из файла
+inline bool loadBoundary(const std::string& filename, double* arr, int size)
+{
+    double* values = new double[(long long)size * size];
+    bool ok = readMatrix(filename, values, size);
+    if (ok)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            arr[i] = values[i];
+            arr[(size - 1) * size + i] = values[(size - 1) * size + i];
+            arr[i * size] = values[i * size];
+            arr[i * size + size - 1] = values[i * size + size - 1];
+        }
+    }
+    delete[] values;
+    return ok;
+}
+
+// Один шаг Якоби по внутренним точкам. K нужен только для Variable (kLen = size * size),
+// для остальных шаблонов достаточно kLen = 1. hf = h^2 * f.
+template <Stencil S, bool HasSource>
+void jacobiSweep(double* Fnew, const double* F, const double* K, int size, int kLen, double hf)
+{
+    long long len = (long long)size * size;
+
+    #pragma acc parallel loop collapse(2) present(Fnew[:len], F[:len], K[:kLen]) async
+    for (int x = 1; x < size - 1; x++)
+    {
+        for (int y = 1; y < size - 1; y++)
+        {
+            const int c = x * size + y;
+            double value;
+            if constexpr (S == Stencil::Five)
+            {
+                value = F[c + size] + F[c - size] + F[c - 1] + F[c + 1];
+                if constexpr (HasSource) value += hf;
+                value *= 0.25;
+            }
+            else if constexpr (S == Stencil::Nine)
+            {
+                // Изотропный 9-точечный шаблон: 20u = 4 * (соседи по сторонам) + (диагональные)
+                value = 4.0 * (F[c + size] + F[c - size] + F[c - 1] + F[c + 1]) +
+                        F[c + size + 1] + F[c + size - 1] + F[c - size + 1] + F[c - size - 1];
+                if constexpr (HasSource) value += 6.0 * hf;
+                value *= 0.05;
+            }
+            else
+            {
+                // Проводимость на гранях - среднее соседних ячеек
+                double kN = 0.5 * (K[c] + K[c - size]);
+                double kS = 0.5 * (K[c] + K[c + size]);
+                double kW = 0.5 * (K[c] + K[c - 1]);
+                double kE = 0.5 * (K[c] + K[c + 1]);
+                value = kN * F[c - size] + kS * F[c + size] + kW * F[c - 1] + kE * F[c + 1];
+                if constexpr (HasSource) value += hf;
+                value /= kN + kS + kW + kE;
+            }
+            Fnew[c] = value;
+        }
+    }
+}
+
+// Пересчёт кольца после шага; углы нужны только 9-точечному шаблону
+template <Boundary B>
+void applyBoundary(double* F, int size)
+{
+    if constexpr (B == Boundary::Dirichlet) return;
+
+    long long len = (long long)size * size;
+    const int last = size - 1;
+
+    #pragma acc parallel loop present(F[:len]) async
+    for (int i = 1; i < last; i++)
+    {
+        if constexpr (B == Boundary::Neumann)
+        {
+            F[i] = F[size + i];
+            F[last * size + i] = F[(last - 1) * size + i];
+            F[i * size] = F[i * size + 1];
+            F[i * size + last] = F[i * size + last - 1];
+            if (i == 1)
+            {
+                F[0] = F[size + 1];
+                F[last] = F[size + last - 1];
+                F[last * size] = F[(last - 1) * size + 1];
+                F[last * size + last] = F[(last - 1) * size + last - 1];
+            }
+        }
+        else
+        {
+            F[i] = F[(last - 1) * size + i];
+            F[last * size + i] = F[size + i];
+            F[i * size] = F[i * size + last - 1];
+            F[i * size + last] = F[i * size + 1];
+            if (i == 1)
+            {
+                F[0] = F[(last - 1) * size + last - 1];
+                F[last] = F[(last - 1) * size + 1];
+                F[last * size] = F[size + last - 1];
+                F[last * size + last] = F[size + 1];
+            }
+        }
+    }
+}
+
+inline void applyBoundary(Boundary boundary, double* F, int size)
+{
+    switch (boundary)
+    {
+    case Boundary::Dirichlet: break;
+    case Boundary::Neumann: applyBoundary<Boundary::Neumann>(F, size); break;
+    case Boundary::Periodic: applyBoundary<Boundary::Periodic>(F, size); break;
+    }
+}
+
+template <Stencil S>
+void jacobiSweep(const StencilConfig& config, double* Fnew, const double* F, const double* K, int size, int kLen, double hf)
+{
+    if (config.hasSource()) jacobiSweep<S, true>(Fnew, F, K, size, kLen, hf);
+    else jacobiSweep<S, false>(Fnew, F, K, size, kLen, hf);
+}
+
+// Шаг Якоби с пересчётом границы: выбирает нужную специализацию
+inline void jacobiStep(const StencilConfig& config, double* Fnew, const double* F, const double* K, int size, int kLen)
+{
+    PROFILE_RANGE("sweep");
+    // Модель для счётчиков: F читается и Fnew пишется по разу (K - ещё раз для var)
+    const double points = double(size - 2) * (size - 2);
+    const int flops = config.stencil == Stencil::Five ? 4 : config.stencil == Stencil::Nine ? 10 : 19;
+    PERF_KERNEL("sweep", points * sizeof(double) * (config.stencil == Stencil::Variable ? 3 : 2), points * flops);
+
+    double h = 1.0 / (size - 1);
+    double hf = h * h * config.source;
+
+    switch (config.stencil)
+    {
+    case Stencil::Five: jacobiSweep<Stencil::Five>(config, Fnew, F, K, size, kLen, hf); break;
+    case Stencil::Nine: jacobiSweep<Stencil::Nine>(config, Fnew, F, K, size, kLen, hf); break;
+    case Stencil::Variable: jacobiSweep<Stencil::Variable>(config, Fnew, F, K, size, kLen, hf); break;
+    }
+
+    applyBoundary(config.boundary, Fnew, size);
+}
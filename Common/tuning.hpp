@@ -0,0 +1,290 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+#include <unistd.h>
+#include <omp.h>
+#include <boost/program_options.hpp>
+
+#include "run_config.hpp"
+
+// Автонастройка параметров под задачу и машину.
+// С --tune программа прогоняет короткие пробные запуски по сетке кандидатов
+// и сохраняет лучший набор в файл этой машины (~/.hpc_tuning/<host>.txt
+// или --tuning-file). Последующие запуски с тем же размером берут настройки
+// из файла, если соответствующие параметры не заданы явно в командной строке.
+//
+// Строка файла: программа <TAB> ключ задачи <TAB> параметры <TAB> время пробы, с
+//   task8	size=1024	block=16,batch=100	0.0123
+
+using TuneParams = std::map<std::string, std::string>;
+
+inline std::string formatParams(const TuneParams& params)
+{
+    std::string out;
+    for (auto& [name, value] : params)
+    {
+        if (!out.empty()) out += ',';
+        out += name + '=' + value;
+    }
+    return out;
+}
+
+inline TuneParams parseParams(const std::string& text)
+{
+    TuneParams params;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        size_t eq = item.find('=');
+        if (eq != std::string::npos) params[item.substr(0, eq)] = item.substr(eq + 1);
+    }
+    return params;
+}
+
+// Целое поле настроек; false, если поля нет или оно не число целиком
+// (файл настройки правится руками и может быть повреждён)
+inline bool paramInt(const TuneParams& params, const std::string& name, int& value)
+{
+    auto it = params.find(name);
+    if (it == params.end() || it->second.empty()) return false;
+    const char* begin = it->second.data();
+    const char* end = begin + it->second.size();
+    int parsed;
+    auto [ptr, ec] = std::from_chars(begin, end, parsed);
+    if (ec != std::errc() || ptr != end) return false;
+    value = parsed;
+    return true;
+}
+
+inline std::string defaultTuningFile()
+{
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    const char* home = std::getenv("HOME");
+    return std::string(home ? home : ".") + "/.hpc_tuning/" + host + ".txt";
+}
+
+class TuningCache {
+public:
+    TuningCache(std::string program, std::string key, std::string filename = "")
+        : program_(std::move(program)), key_(std::move(key)),
+          filename_(filename.empty() ? defaultTuningFile() : std::move(filename)) {}
+
+    bool load(TuneParams& params) const
+    {
+        std::ifstream file(filename_);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::vector<std::string> fields = split(line);
+            if (fields.size() >= 3 && fields[0] == program_ && fields[1] == key_)
+            {
+                params = parseParams(fields[2]);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Заменяет запись для этой программы и ключа, остальные строки сохраняются
+    bool save(const TuneParams& params, double seconds) const
+    {
+        std::vector<std::string> lines;
+        {
+            std::ifstream file(filename_);
+            std::string line;
+            while (std::getline(file, line))
+            {
+                std::vector<std::string> fields = split(line);
+                if (fields.size() >= 2 && fields[0] == program_ && fields[1] == key_) continue;
+                lines.push_back(line);
+            }
+        }
+        std::ostringstream entry;
+        entry << program_ << '\t' << key_ << '\t' << formatParams(params) << '\t' << seconds;
+        lines.push_back(entry.str());
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(filename_).parent_path(), ec);
+        std::ofstream file(filename_);
+        if (!file.is_open())
+        {
+            std::cerr << "Unable to open file " << filename_ << " for writing." << std::endl;
+            return false;
+        }
+        for (const std::string& line : lines)
+        {
+            file << line << '\n';
+        }
+        return true;
+    }
+
+    const std::string& filename() const { return filename_; }
+
+private:
+    std::string program_;
+    std::string key_;
+    std::string filename_;
+
+    static std::vector<std::string> split(const std::string& line)
+    {
+        std::vector<std::string> fields;
+        std::istringstream in(line);
+        std::string field;
+        while (std::getline(in, field, '\t'))
+        {
+            fields.push_back(field);
+        }
+        return fields;
+    }
+};
+
+// Декартово произведение значений параметров
+inline std::vector<TuneParams> tuneGrid(const std::vector<std::pair<std::string, std::vector<std::string>>>& axes)
+{
+    std::vector<TuneParams> grid(1);
+    for (auto& [name, values] : axes)
+    {
+        std::vector<TuneParams> next;
+        for (const TuneParams& partial : grid)
+        {
+            for (const std::string& value : values)
+            {
+                TuneParams params = partial;
+                params[name] = value;
+                next.push_back(params);
+            }
+        }
+        grid.swap(next);
+    }
+    return grid;
+}
+
+// 1, 2, 4, ... и число процессоров машины
+inline std::vector<std::string> threadCandidates()
+{
+    std::vector<std::string> values;
+    int procs = omp_get_num_procs();
+    for (int t = 1; t < procs; t *= 2)
+    {
+        values.push_back(std::to_string(t));
+    }
+    values.push_back(std::to_string(procs));
+    return values;
+}
+
+// trial(params) возвращает время пробы в секундах; каждая проба - лучшее из двух
+template <class Trial>
+std::pair<TuneParams, double> autotune(const std::vector<TuneParams>& candidates, Trial&& trial)
+{
+    TuneParams best;
+    double bestTime = -1;
+
+    std::cout << "Tuning " << candidates.size() << " configurations:" << std::endl;
+    for (const TuneParams& params : candidates)
+    {
+        double seconds = std::min(trial(params), trial(params));
+        std::cout << '\t' << formatParams(params) << "\t" << seconds * 1000.0 << " ms" << std::endl;
+        if (bestTime < 0 || seconds < bestTime)
+        {
+            bestTime = seconds;
+            best = params;
+        }
+    }
+    std::cout << "Best: " << formatParams(best) << std::endl;
+    return { best, bestTime };
+}
+
+inline void addTuningOptions(boost::program_options::options_description& desc)
+{
+    namespace po = boost::program_options;
+    desc.add_options()
+        ("tune", po::bool_switch(), "Run trial sweeps and save the best settings for this host")
+        ("tuning-file", po::value<std::string>()->default_value(""), "Tuning cache (default ~/.hpc_tuning/<host>.txt)")
+    ;
+}
+
+// Работа одной пробы, в элементарных шагах
+constexpr double TUNE_TRIAL_WORK = 1e7;
+
+// Размер пробной задачи: работа ~ size^workExponent урезается до TUNE_TRIAL_WORK
+inline int trialSize(int size, int workExponent)
+{
+    return std::min(size, int(std::lround(std::pow(TUNE_TRIAL_WORK, 1.0 / workExponent))));
+}
+
+// Настройка расписания, chunk и числа потоков для программ на RunConfig.
+// trial(config) выполняет пробный запуск с config.threads из одного значения
+// и уменьшенным config.size: работа ~ size^workExponent урезается до TUNE_TRIAL_WORK.
+// Без --tune подставляет сохранённые значения для параметров, не заданных явно.
+template <class Trial>
+bool tuneRunConfig(RunConfig& config, const boost::program_options::variables_map& vm,
+                   const std::string& program, int workExponent, Trial&& trial)
+{
+    // Сильное и слабое масштабирование настраиваются отдельно
+    TuningCache cache(program, "size=" + std::to_string(config.size) + ",precision=" + config.precision +
+                      (config.weak ? ",weak" : ""), vm["tuning-file"].as<std::string>());
+    TuneParams params;
+
+    if (vm["tune"].as<bool>())
+    {
+        std::vector<TuneParams> candidates;
+        const std::vector<std::pair<std::string, std::string>> schedules = {
+            { "static", "0" }, { "dynamic", "64" }, { "dynamic", "1024" }, { "dynamic", "16384" },
+            { "guided", "0" }, { "guided", "1024" } };
+        for (const std::string& threads : threadCandidates())
+        {
+            for (auto& [schedule, chunk] : schedules)
+            {
+                candidates.push_back({ { "threads", threads }, { "schedule", schedule }, { "chunk", chunk } });
+            }
+        }
+
+        const int size = trialSize(config.size, workExponent);
+        std::cout << "Trial size: " << size << std::endl;
+        auto [best, seconds] = autotune(candidates, [&](const TuneParams& p) {
+            RunConfig trialConfig = config;
+            trialConfig.size = size;
+            trialConfig.schedule = p.at("schedule");
+            trialConfig.chunk = std::stoi(p.at("chunk"));
+            trialConfig.threads = { std::stoi(p.at("threads")) };
+            trialConfig.applySchedule();
+            return trial(trialConfig);
+        });
+        if (cache.save(best, seconds)) std::cout << "Saved to " << cache.filename() << std::endl;
+        params = best;
+    }
+    else if (!cache.load(params))
+    {
+        return config.applySchedule();
+    }
+
+    int chunk = 0;
+    int threads = 0;
+    const std::string& schedule = params["schedule"];
+    if (!paramInt(params, "chunk", chunk) || chunk < 0 || !paramInt(params, "threads", threads) || threads < 1 ||
+        (schedule != "static" && schedule != "dynamic" && schedule != "guided"))
+    {
+        std::cerr << "Ignoring a corrupt entry for " << program << " in " << cache.filename() << std::endl;
+        return config.applySchedule();
+    }
+
+    if (vm["schedule"].defaulted() && vm["chunk"].defaulted())
+    {
+        config.schedule = schedule;
+        config.chunk = chunk;
+    }
+    if (vm["threads"].defaulted()) config.threads = { threads };
+    return config.applySchedule();
+}
@@ -1,36 +1,33 @@
 #include <iostream>
 #include <cmath>
 
-#define arr_elem 10000000
-
-#ifdef d_double
-using nspace = double;
-#else
-using nspace = float;
-#endif // d_double
+#include "../Common/run_config.hpp"
+#include "../Common/lazy_vector.hpp"
 
+// Сумма считается одним проходом без промежуточного массива
+template <typename nspace>
+nspace sinSum(int arr_elem)
+{
+    const nspace pi = std::acos(-1);
 
-const nspace pi = std::acos(-1);
+    return lazy::sum(lazy::sin(2*pi*lazy::iota<nspace>(arr_elem)/arr_elem));
+}
 
 int main(int argc, char const* argv[])
 {
-    nspace sum = 0;
-    nspace* array;
-    array = new nspace[arr_elem];
-
-    for (int i = 0; i < arr_elem; ++i)
-    {
-        array[i] = sin(2*pi*i/arr_elem);
-    }
-
-    for (int i = 0; i < arr_elem; ++i)
-    {
-        sum += array[i];
-    }
-
-    std::cout << sum << std::endl;
-    
-    delete(array);
-    
-    return 0;
-}
\ No newline at end of file
+    RunConfig config;
+    po::options_description desc("options");
+    desc.add_options()
+        ("size", po::value<int>(&config.size)->default_value(10000000), "Array size")
+        ("precision", po::value<std::string>(&config.precision)->default_value("float"), "float or double")
+        ("help", "Show all command")
+    ;
+
+    po::variables_map vm;
+    if (!parseRunOptions(argc, argv, desc, vm)) return 1;
+
+    return dispatchPrecision(config, [&]<typename T>() {
+        std::cout << sinSum<T>(config.size) << std::endl;
+        return 0;
+    });
+}
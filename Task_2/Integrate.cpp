@@ -1,28 +1,40 @@
 #include <iostream>
 #include <cmath>
 #include <chrono>
+#include <limits>
 #include <omp.h>
 
-#define numThreads 40
+#include "../Common/run_config.hpp"
+#include "../Common/tuning.hpp"
 
-double func(double x) 
+// Глубина, начиная с которой подотрезки считаются без порождения новых задач
+constexpr int TASK_DEPTH = 12;
+constexpr int MAX_DEPTH = 50;
+// Расхождение половин в пределах ROUNDOFF_ULPS машинных эпсилон от суммы - шум округления.
+// Во float --tol по умолчанию (1e-12) ниже точности типа, и без этой границы
+// каждый отрезок делился бы до MAX_DEPTH.
+constexpr int ROUNDOFF_ULPS = 8;
+
+template <typename T>
+T func(T x) 
 {
-    return exp(-x * x);
+    return std::exp(-x * x);
 }
 
-double midpointRectangleIntegration(double a, double b, int n) 
+template <typename T>
+T midpointRectangleIntegration(T a, T b, int n, int numThreads) 
 {
-    double h = (b - a) / n;
-    double sum = 0.0;
+    T h = (b - a) / n;
+    T sum = 0.0;
 
     #pragma omp parallel num_threads(numThreads)
     {
-        double temp;
+        T temp = 0.0;
 
-        #pragma omp for schedule(dynamic, 10000)
+        #pragma omp for schedule(runtime)
         for (int i = 0; i < n; i++) 
         {
-            double x_midpoint = a + h/2 + i*h;
+            T x_midpoint = a + h/2 + i*h;
             temp += func(x_midpoint);
         }
 
@@ -33,18 +45,170 @@ double midpointRectangleIntegration(double a, double b, int n)
     return h * sum;
 }
 
-int main(int argc, char const* argv[]) {
-    double a = -4.0; 
-    double b = 4.0; 
-    int nsteps = 40000000; 
+// Формула Симпсона (точна для многочленов 3 степени)
+template <typename T>
+struct SimpsonRule
+{
+    using value_type = T;
+    static constexpr int points = 3;
+    static constexpr T richardson = 15.0; // 2^4 - 1
+
+    static T apply(T a, T b)
+    {
+        return (b - a) / 6 * (func(a) + 4 * func(T(0.5) * (a + b)) + func(b));
+    }
+};
+
+// 5-точечная квадратура Гаусса-Лежандра (точна для многочленов 9 степени)
+template <typename T>
+struct GaussLegendreRule
+{
+    using value_type = T;
+    static constexpr int points = 5;
+    static constexpr T richardson = 1023.0; // 2^10 - 1
+
+    static T apply(T a, T b)
+    {
+        static constexpr double nodes[points] = {
+            -0.9061798459386640, -0.5384693101056831, 0.0, 0.5384693101056831, 0.9061798459386640
+        };
+        static constexpr double weights[points] = {
+            0.2369268850561891, 0.4786286704993665, 0.5688888888888889, 0.4786286704993665, 0.2369268850561891
+        };
+
+        T half = T(0.5) * (b - a);
+        T mid = T(0.5) * (a + b);
+        T sum = 0.0;
+        for (int i = 0; i < points; i++)
+        {
+            sum += T(weights[i]) * func(mid + half * T(nodes[i]));
+        }
+        return half * sum;
+    }
+};
+
+// Отрезок делится пополам, пока оценка Рунге не станет меньше tol.
+// Половины обрабатываются как задачи OpenMP, которые разбирают свободные потоки.
+// Если расхождение уже на уровне ошибок округления, дальнейшее деление бесполезно.
+template <class Rule, typename T = typename Rule::value_type>
+T adaptiveSegment(T a, T b, T whole, T tol, int depth, long long* evals)
+{
+    T m = T(0.5) * (a + b);
+    T left = Rule::apply(a, m);
+    T right = Rule::apply(m, b);
+
+    #pragma omp atomic
+    *evals += 2 * Rule::points;
+
+    T delta = left + right - whole;
+    if (depth >= MAX_DEPTH || std::abs(delta) <= Rule::richardson * tol ||
+        std::abs(delta) <= ROUNDOFF_ULPS * std::numeric_limits<T>::epsilon() * std::abs(left + right))
+    {
+        return left + right + delta / Rule::richardson;
+    }
+
+    T leftSum, rightSum;
+
+    #pragma omp task shared(leftSum) final(depth >= TASK_DEPTH)
+    leftSum = adaptiveSegment<Rule>(a, m, left, tol / 2, depth + 1, evals);
+
+    #pragma omp task shared(rightSum) final(depth >= TASK_DEPTH)
+    rightSum = adaptiveSegment<Rule>(m, b, right, tol / 2, depth + 1, evals);
+
+    #pragma omp taskwait
+    return leftSum + rightSum;
+}
+
+template <class Rule, typename T = typename Rule::value_type>
+T adaptiveIntegration(T a, T b, T tol, long long& evals, int numThreads)
+{
+    T result = 0.0;
+    evals = Rule::points;
+    T whole = Rule::apply(a, b);
+
+    #pragma omp parallel num_threads(numThreads)
+    {
+        #pragma omp single
+        result = adaptiveSegment<Rule>(a, b, whole, tol, 0, &evals);
+    }
+
+    return result;
+}
+
+template <class F>
+void report(const char* name, F&& integrate, double exact)
+{
+    long long evals = 0;
 
     auto begin = std::chrono::steady_clock::now();
-    double result = midpointRectangleIntegration(a, b, nsteps);
+    double result = integrate(evals);
     auto end = std::chrono::steady_clock::now();
-    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin);
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
+
+    std::cout << name << ":\n";
+    std::cout << "\tThe time: " << elapsed_us.count() / 1000.0 << " ms\n";
+    std::cout << "\tResult: " << result << "\n";
+    std::cout << "\tError: " << std::abs(result - exact) << "\n";
+    std::cout << "\tEvaluations: " << evals << std::endl;
+}
+
+template <typename T>
+void integrateAll(int nsteps, int numThreads, T tol)
+{
+    T a = -4.0; 
+    T b = 4.0; 
+    double exact = std::sqrt(std::acos(-1.0)) * std::erf(4.0);
+
+    std::cout << "Threads: " << numThreads << "\tSteps: " << nsteps << std::endl;
+
+    report("Midpoint", [&](long long& evals) {
+        evals = nsteps;
+        return midpointRectangleIntegration<T>(a, b, nsteps, numThreads);
+    }, exact);
 
-    std::cout << "The time: " << elapsed_ms.count() << " ms\n";
-    std::cout << "Result:" << result << std::endl;
-    
-    return 0;
-}
\ No newline at end of file
+    report("Adaptive Simpson", [&](long long& evals) {
+        return adaptiveIntegration<SimpsonRule<T>>(a, b, tol, evals, numThreads);
+    }, exact);
+
+    report("Adaptive Gauss-Legendre", [&](long long& evals) {
+        return adaptiveIntegration<GaussLegendreRule<T>>(a, b, tol, evals, numThreads);
+    }, exact);
+}
+
+int main(int argc, char const* argv[]) {
+    RunConfig config;
+    double tol;
+    po::options_description desc("options");
+    addRunOptions(desc, config, 40000000, 40);
+    addTuningOptions(desc);
+    desc.add_options()
+        ("tol", po::value<double>(&tol)->default_value(1e-12), "Tolerance of the adaptive methods");
+
+    po::variables_map vm;
+    if (!parseRunOptions(argc, argv, desc, vm)) return 1;
+
+    // Если расписание не задано, оставляем прежнее dynamic, 10000
+    if (vm["schedule"].defaulted() && vm["chunk"].defaulted())
+    {
+        config.schedule = "dynamic";
+        config.chunk = 10000;
+    }
+
+    return dispatchPrecision(config, [&]<typename T>() {
+        // Проба - метод прямоугольников: от расписания зависит именно его цикл
+        bool ok = tuneRunConfig(config, vm, "integrate", 1, [&](const RunConfig& trial) {
+            double start = omp_get_wtime();
+            midpointRectangleIntegration<T>(T(-4.0), T(4.0), trial.size, trial.threads[0]);
+            return omp_get_wtime() - start;
+        });
+        if (!ok) return 1;
+
+        std::cout.precision(16);
+        for (int numThreads : config.threads)
+        {
+            // Работа метода прямоугольников линейна по числу шагов
+            integrateAll<T>(config.scaledSize(numThreads, 1), numThreads, T(tol));
+        }
+        return 0;
+    });
+}
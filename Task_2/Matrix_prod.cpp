@@ -2,45 +2,182 @@
 #include <cmath>
 #include <chrono>
 #include <omp.h>
-#include <memory>
 
-#define arr_elem 20000
-#define numThreads 16
+#include "../Common/run_config.hpp"
+#include "../Common/tuning.hpp"
+#include "../Common/aligned_buffer.hpp"
+#include "../Common/multi_rhs.hpp"
+#include "../Common/lazy_vector.hpp"
+#include "../Common/profile.hpp"
+#include "../Common/perf_counters.hpp"
 
-int main(int argc, char const* argv[])
+template <typename T>
+double matrixProduct(int arr_elem, int numThreads)
 {
-    std::shared_ptr<double[]> matrix(new double[arr_elem * arr_elem]);
-    std::shared_ptr<double[]> vector(new double[arr_elem]);
-    std::shared_ptr<double[]> answer(new double[arr_elem]);
+    AlignedBuffer<T> matrix(size_t(arr_elem) * arr_elem);
+    AlignedBuffer<T> vector(arr_elem);
+    AlignedBuffer<T> answer(arr_elem);
 
     auto begin = std::chrono::steady_clock::now();
     #pragma omp parallel num_threads(numThreads)
     {
-        #pragma omp for
-        for (int i = 0; i < arr_elem * arr_elem; i++)
-        {
-            matrix[i] = (i % (arr_elem + 1) == 0) ? 2.0 : 1.0;
-        }
-        
-        #pragma omp for
-        for (int i = 0; i < arr_elem; i++)
         {
-            vector[i] = double(i) + 1.0;
+            PROFILE_RANGE("init");
+            // Первое касание теми же статическими блоками, что и у расчёта с --schedule static (по умолчанию)
+            #pragma omp for schedule(static)
+            for (int i = 0; i < arr_elem; i++)
+            {
+                for (int j = 0; j < arr_elem; j++)
+                {
+                    matrix[size_t(i) * arr_elem + j] = (i == j) ? 2.0 : 1.0;
+                }
+            }
+            
+            lazy::assign(vector, lazy::iota<T>(arr_elem) + 1.0);
         }
 
-        #pragma omp for collapse(2) nowait
+        PROFILE_RANGE("matvec");
+        // Модель: матрица читается один раз, 2 операции на элемент
+        PERF_KERNEL("matvec", double(arr_elem) * arr_elem * sizeof(T), 2.0 * arr_elem * arr_elem);
+        #pragma omp for schedule(runtime) nowait
         for (int i = 0; i < arr_elem; i++) 
         {
+            T sum = 0;
             for (int j = 0; j < arr_elem; j++) 
             {
-                answer[i] += matrix[i * arr_elem + j] * vector[j];
+                sum += matrix[size_t(i) * arr_elem + j] * vector[j];
             }
+            answer[i] = sum;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+// Строк матрицы в порции расписания для нескольких векторов (кратно MULTI_RHS_MR)
+constexpr int MULTI_RHS_ROWS = 64;
+
+// Y = A X для k векторов за один проход по матрице; время - упаковка и умножение
+template <typename T>
+double multiplyMultiRhs(const AlignedBuffer<T>& matrix, int arr_elem, int k, int numThreads, double& error)
+{
+    AlignedBuffer<T> vectors(size_t(k) * arr_elem);
+    AlignedBuffer<T> packed(size_t(k) * arr_elem);
+    AlignedBuffer<T> answer(size_t(k) * arr_elem);
+    const int tiles = (arr_elem + MULTI_RHS_ROWS - 1) / MULTI_RHS_ROWS;
+
+    #pragma omp parallel for num_threads(numThreads)
+    for (int v = 0; v < k; v++)
+    {
+        lazy::assign(vectors.get() + size_t(v) * arr_elem, lazy::iota<T>(arr_elem) + (1.0 + v), 0, arr_elem);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    #pragma omp parallel num_threads(numThreads)
+    {
+        #pragma omp for schedule(runtime)
+        for (int tile = 0; tile < tiles; tile++)
+        {
+            int start = tile * MULTI_RHS_ROWS;
+            packRhs(vectors.get(), packed.get(), arr_elem, k, start, std::min(start + MULTI_RHS_ROWS, arr_elem));
+        }
+
+        PROFILE_RANGE("matvec_multi");
+        // Модель: матрица читается один раз, 2k операции на элемент
+        PERF_KERNEL("matvec_multi", double(arr_elem) * arr_elem * sizeof(T), 2.0 * arr_elem * arr_elem * k);
+        #pragma omp for schedule(runtime) nowait
+        for (int tile = 0; tile < tiles; tile++)
+        {
+            int start = tile * MULTI_RHS_ROWS;
+            multiRhsRows(matrix.get(), packed.get(), answer.get(), arr_elem, k,
+                         start, std::min(start + MULTI_RHS_ROWS, arr_elem));
         }
     }
     auto end = std::chrono::steady_clock::now();
-    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin);
 
-    std::cout << "The time: " << elapsed_ms.count() << " ms\n";
+    error = multiRhsMaxError(answer.get(), arr_elem, k);
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+// Матрица заполняется один раз на размер, затем умножается на 1, 2, ... k векторов
+template <typename T>
+void multiRhsSweep(const RunConfig& config, const std::vector<int>& rhs)
+{
+    for (int numThreads : config.threads)
+    {
+        int size = config.scaledSize(numThreads, 2);
+        AlignedBuffer<T> matrix(size_t(size) * size);
+
+        #pragma omp parallel for schedule(runtime) num_threads(numThreads)
+        for (int i = 0; i < size; i++)
+        {
+            for (int j = 0; j < size; j++)
+            {
+                matrix[size_t(i) * size + j] = (i == j) ? 2.0 : 1.0;
+            }
+        }
+
+        MultiRhsReport report(numThreads, size);
+        for (int k : rhs)
+        {
+            double error = 0;
+            double seconds = multiplyMultiRhs<T>(matrix, size, k, numThreads, error);
+            report.add(k, size, seconds, error);
+        }
+    }
+}
+
+int main(int argc, char const* argv[])
+{
+    RunConfig config;
+    po::options_description desc("options");
+    addRunOptions(desc, config, 20000, 16);
+    addTuningOptions(desc);
+    desc.add_options()
+        ("rhs", po::value<std::vector<int>>()->multitoken(),
+            "Multiply by several vectors per matrix pass, e.g. --rhs 1 2 4 8 16 32 64")
+    ;
+
+    po::variables_map vm;
+    if (!parseRunOptions(argc, argv, desc, vm)) return 1;
 
-    return 0;
-}
\ No newline at end of file
+    // k задаёт ширину панели правых частей и делитель в размере блока
+    if (vm.count("rhs"))
+    {
+        for (int k : vm["rhs"].as<std::vector<int>>())
+        {
+            if (k < 1)
+            {
+                std::cerr << "--rhs values must be at least 1" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return dispatchPrecision(config, [&]<typename T>() {
+        bool ok = tuneRunConfig(config, vm, "matrix_prod", 2, [&](const RunConfig& trial) {
+            return matrixProduct<T>(trial.size, trial.threads[0]);
+        });
+        if (!ok) return 1;
+
+        if (vm.count("rhs"))
+        {
+            multiRhsSweep<T>(config, vm["rhs"].as<std::vector<int>>());
+            PROFILE_REPORT();
+            PERF_REPORT();
+            return 0;
+        }
+
+        ScalingReport report(config);
+        for (int numThreads : config.threads)
+        {
+            // Работа умножения матрицы на вектор ~ size^2
+            int size = config.scaledSize(numThreads, 2);
+            report.add(numThreads, size, matrixProduct<T>(size, numThreads));
+        }
+        PROFILE_REPORT();
+        PERF_REPORT();
+        return 0;
+    });
+}
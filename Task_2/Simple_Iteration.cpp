@@ -2,95 +2,160 @@
 #include <cmath>
 #include <chrono>
 #include <omp.h>
-#include <memory>
 
-#define arr_elem 1000
-#define numThreads 16
+#include "../Common/run_config.hpp"
+#include "../Common/aligned_buffer.hpp"
+#include "../Common/lazy_vector.hpp"
+#include "../Common/profile.hpp"
+#include "../Common/perf_counters.hpp"
 
-int main(int argc, char const* argv[]) 
+// Частичная сумма квадратов невязки одного потока, по строке кэша на поток
+template <typename T>
+struct alignas(CACHE_LINE) PartialNorm
+{
+    T value;
+};
+
+// Итерация x_{k+1} = x_k - t (A x_k - b) за один проход по матрице:
+// строка даёт и компоненту невязки r_k (в норму), и обновлённую компоненту x_{k+1}.
+// Норма ||r_k|| - критерий остановки для x_k, поэтому последовательность
+// приближений и ответ те же, что при отдельном умножении для невязки.
+// На итерацию один барьер: частичные нормы пишутся в один из двух наборов
+// по чётности итерации, и к моменту, когда набор переписывается снова,
+// все потоки уже прошли следующий барьер и прочитали его.
+template <typename T>
+double simpleIteration(int arr_elem, int numThreads)
 {
-    std::shared_ptr<double[]> matrix(new double[arr_elem * arr_elem]);
-    std::shared_ptr<double[]> vector_x(new double[arr_elem]);
-    std::shared_ptr<double[]> vector_b(new double[arr_elem]);
-    std::shared_ptr<double[]> temp_values(new double[arr_elem]);
+    AlignedBuffer<T> matrix(size_t(arr_elem) * arr_elem);
+    AlignedBuffer<T> vector_b(arr_elem);
+    AlignedBuffer<T> bufferX(arr_elem);
+    AlignedBuffer<T> bufferNext(arr_elem);
+    AlignedBuffer<PartialNorm<T>> partials(2 * size_t(numThreads));
+
+    T eps = 0.00001;
+    T t = 0.00001;
+    T norm_v_b = sqrt((T(arr_elem) + 1.0) * (T(arr_elem) + 1.0) * T(arr_elem));
+
+    T* result = bufferX.get();
+    int iterations = 0;
 
-    double eps = 0.00001;
-    double t = 0.00001;
-    double term = 0.0;
-    double norm_v_b = sqrt((double(arr_elem) + 1.0) * (double(arr_elem) + 1.0) * double(arr_elem));
+    // Модель для счётчиков: одно умножение матрицы на вектор на итерацию
+    const double matvecBytes = double(arr_elem) * arr_elem * sizeof(T);
+    const double matvecFlops = 2.0 * arr_elem * arr_elem + 5.0 * arr_elem;
 
     auto begin = std::chrono::steady_clock::now();
     #pragma omp parallel num_threads(numThreads)
     {
-        #pragma omp for
-        for (int i = 0; i < arr_elem * arr_elem; i++)
-        {
-            matrix[i] = (i % (arr_elem + 1) == 0) ? 2.0 : 1.0;
-        }
+        const int thread = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
 
-        #pragma omp for
-        for (int i = 0; i < arr_elem; i++)
         {
-            vector_b[i] = double(arr_elem) + 1.0;
-        }
+            PROFILE_RANGE("init");
+            // Первое касание теми же статическими блоками, что и у расчёта с --schedule static (по умолчанию)
+            #pragma omp for schedule(static)
+            for (int i = 0; i < arr_elem; i++)
+            {
+                for (int j = 0; j < arr_elem; j++)
+                {
+                    matrix[size_t(i) * arr_elem + j] = (i == j) ? 2.0 : 1.0;
+                }
+            }
 
-        #pragma omp for
-        for (int i = 0; i < arr_elem; i++)
-        {
-            vector_x[i] = 0.0;
+            lazy::assign(vector_b, lazy::fill<T>(arr_elem, T(arr_elem) + 1.0));
+            lazy::assign(bufferX, lazy::fill<T>(arr_elem, 0.0));
+            lazy::assign(bufferNext, lazy::fill<T>(arr_elem, 0.0));
         }
 
-        #pragma omp for
-        for (int i = 0; i < arr_elem; i++)
-        {
-            temp_values[i] = 0.0;
-        }
-        
-        while (true) {
+        // Указатели у каждого потока свои и меняются одинаково
+        T* x = bufferX.get();
+        T* next = bufferNext.get();
+        int parity = 0;
+        int iteration = 0;
 
-            #pragma omp for schedule(dynamic, 10)
-            for (int i = 0; i < arr_elem; ++i) 
+        while (true) {
+            iteration++;
+            T partial = 0;
             {
-                double sum = 0;
-                for (int j = 0; j < arr_elem; ++j) 
+                PROFILE_RANGE("sweep+residual");
+                PERF_KERNEL("sweep+residual", matvecBytes, matvecFlops);
+                #pragma omp for schedule(runtime) nowait
+                for (int i = 0; i < arr_elem; ++i) 
                 {
-                    sum += matrix[i * arr_elem + j] * temp_values[j];
+                    const T* row = matrix.get() + size_t(i) * arr_elem;
+                    T sum = 0;
+                    #pragma omp simd reduction(+:sum)
+                    for (int j = 0; j < arr_elem; ++j) 
+                    {
+                        sum += row[j] * x[j];
+                    }
+                    T residual = sum - vector_b[i];
+                    next[i] = x[i] - t * residual;
+                    partial += residual * residual;
                 }
-                vector_x[i] = temp_values[i] - t * (sum - vector_b[i]);
+                partials[parity * threads + thread].value = partial;
+
+                #pragma omp barrier
             }
-            
-            // Критерий остановки
-            term = 0.0;
 
-            #pragma omp for
-            for (int i = 0; i < arr_elem; ++i) 
+            // Каждый поток сам складывает частичные суммы в одном порядке - решение одинаковое
+            T term = 0;
+            for (int k = 0; k < threads; k++)
             {
-                double sum = 0;
-                for (int j = 0; j < arr_elem; ++j) 
-                {
-                    sum += matrix[i * arr_elem + j] * vector_x[j];
-                }
-                term += (sum - vector_b[i]) * (sum - vector_b[i]);
+                term += partials[parity * threads + k].value;
             }
 
+            // Критерий остановки
             if (std::abs(sqrt(term) / norm_v_b) < eps)
             {
+                if (thread == 0)
+                {
+                    result = x;
+                    iterations = iteration;
+                }
                 break;
             }
-            
-            for (int i = 0; i < arr_elem; i++)
-            {
-                temp_values[i] = vector_x[i];
-            }
+
+            std::swap(x, next);
+            parity ^= 1;
         }
     }
 
     auto end = std::chrono::steady_clock::now();
-    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin);
+    double seconds = std::chrono::duration<double>(end - begin).count();
 
-    std::cout << "Vector: " << vector_x[0];
+    std::cout << "Vector: " << result[0] << "\tIterations: " << iterations
+              << "\tPer iteration: " << seconds / iterations * 1000.0 << " ms" << std::endl;
 
-    std::cout << "\n The time: " << elapsed_ms.count() << " ms\n";
+    return seconds;
+}
 
-    return 0;
+int main(int argc, char const* argv[]) 
+{
+    RunConfig config;
+    po::options_description desc("options");
+    addRunOptions(desc, config, 1000, 16);
+
+    po::variables_map vm;
+    if (!parseRunOptions(argc, argv, desc, vm)) return 1;
+
+    // Если расписание не задано, оставляем прежнее dynamic, 10
+    if (vm["schedule"].defaulted() && vm["chunk"].defaulted())
+    {
+        config.schedule = "dynamic";
+        config.chunk = 10;
+    }
+    if (!config.applySchedule()) return 1;
+
+    return dispatchPrecision(config, [&]<typename T>() {
+        ScalingReport report(config);
+        for (int numThreads : config.threads)
+        {
+            // Одна итерация - умножение матрицы на вектор, работа ~ size^2
+            int size = config.scaledSize(numThreads, 2);
+            report.add(numThreads, size, simpleIteration<T>(size, numThreads));
+        }
+        PROFILE_REPORT();
+        PERF_REPORT();
+        return 0;
+    });
 }
\ No newline at end of file
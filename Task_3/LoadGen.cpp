@@ -0,0 +1,252 @@
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <boost/program_options.hpp>
+
+#include "ipc_protocol.hpp"
+
+namespace po = boost::program_options;
+using Clock = std::chrono::steady_clock;
+
+// Генератор нагрузки для server --socket: по соединению на поток, в каждом до depth
+// запросов в полёте, запросы уходят пачками по batch кадров на один write.
+// Ответы сверяются с sin/sqrt/pow, задержка - от отправки пачки до получения ответа.
+
+struct LoadConfig
+{
+    std::string socket_path;
+    int connections;
+    int requests;
+    int depth;
+    int batch;
+    int keys;
+    int function;
+    int priority;
+    int deadline_us;
+};
+
+struct ConnectionStats
+{
+    std::vector<double> latencies;
+    size_t errors = 0;
+    size_t shed = 0;
+    bool failed = false;
+};
+
+double expected(int function, double arg)
+{
+    if (function == int(IpcFunction::Sin)) return std::sin(arg);
+    if (function == int(IpcFunction::Sqrt)) return std::sqrt(arg);
+    return std::pow(arg, 2.0);
+}
+
+bool write_all(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void run_connection(const LoadConfig& config, int index, ConnectionStats& stats)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, config.socket_path.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        std::cerr << "connect " << config.socket_path << ": " << std::strerror(errno) << std::endl;
+        stats.failed = true;
+        if (fd >= 0) close(fd);
+        return;
+    }
+
+    std::mt19937 generator(index + 1);
+    std::uniform_real_distribution<double> random_arg(1.0, 10.0);
+    std::uniform_int_distribution<int> random_key(0, std::max(config.keys, 1) - 1);
+    std::uniform_int_distribution<int> random_function(0, int(IpcFunction::Count) - 1);
+
+    // Запрос с tag = i; аргумент и функция хранятся для проверки ответа
+    std::vector<double> args(config.requests);
+    std::vector<uint8_t> functions(config.requests);
+    std::vector<Clock::time_point> sent_at(config.requests);
+    stats.latencies.reserve(config.requests);
+
+    std::vector<RequestFrame> frames;
+    std::vector<char> in;
+    char buffer[64 * 1024];
+    int sent = 0;
+    int received = 0;
+
+    while (received < config.requests)
+    {
+        // Досылаем до depth запросов в полёте
+        while (sent < config.requests && sent - received < config.depth)
+        {
+            int count = std::min({ config.batch, config.depth - (sent - received), config.requests - sent });
+            frames.clear();
+            for (int i = 0; i < count; ++i)
+            {
+                int tag = sent + i;
+                args[tag] = config.keys > 0 ? 1.0 + 9.0 * random_key(generator) / config.keys : random_arg(generator);
+                functions[tag] = uint8_t(config.function >= 0 ? config.function : random_function(generator));
+                frames.push_back({ uint64_t(tag), args[tag], uint32_t(config.deadline_us),
+                                   functions[tag], uint8_t(config.priority), 0 });
+            }
+            auto now = Clock::now();
+            for (int i = 0; i < count; ++i)
+            {
+                sent_at[sent + i] = now;
+            }
+            if (!write_all(fd, reinterpret_cast<const char*>(frames.data()), frames.size() * sizeof(RequestFrame)))
+            {
+                std::cerr << "write: " << std::strerror(errno) << std::endl;
+                stats.failed = true;
+                close(fd);
+                return;
+            }
+            sent += count;
+        }
+
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+        {
+            std::cerr << "Server closed the connection" << std::endl;
+            stats.failed = true;
+            close(fd);
+            return;
+        }
+        auto now = Clock::now();
+        in.insert(in.end(), buffer, buffer + n);
+
+        size_t count = in.size() / sizeof(ResponseFrame);
+        for (size_t i = 0; i < count; ++i)
+        {
+            ResponseFrame response;
+            std::memcpy(&response, in.data() + i * sizeof(ResponseFrame), sizeof(ResponseFrame));
+            if (response.tag >= uint64_t(config.requests))
+            {
+                stats.errors++;
+                continue;
+            }
+            size_t tag = response.tag;
+            stats.latencies.push_back(std::chrono::duration<double, std::micro>(now - sent_at[tag]).count());
+            if (std::isnan(response.value)) stats.shed++;
+            else if (response.arg != args[tag] || std::abs(response.value - expected(functions[tag], args[tag])) > 0.001)
+            {
+                stats.errors++;
+            }
+            received++;
+        }
+        in.erase(in.begin(), in.begin() + count * sizeof(ResponseFrame));
+    }
+    close(fd);
+}
+
+int main(int argc, char const* argv[])
+{
+    LoadConfig config;
+    std::string function;
+
+    po::options_description desc("options");
+    desc.add_options()
+        ("socket", po::value<std::string>(&config.socket_path)->default_value("/tmp/task3_server.sock"), "Server socket")
+        ("connections", po::value<int>(&config.connections)->default_value(4), "Connections, one thread each")
+        ("requests", po::value<int>(&config.requests)->default_value(200000), "Requests per connection")
+        ("depth", po::value<int>(&config.depth)->default_value(256), "Requests in flight per connection (at most 4096)")
+        ("batch", po::value<int>(&config.batch)->default_value(64), "Requests per write")
+        ("keys", po::value<int>(&config.keys)->default_value(0), "Distinct arguments (0 - random)")
+        ("function", po::value<std::string>(&function)->default_value("mix"), "sin, sqrt, pow or mix")
+        ("priority", po::value<int>(&config.priority)->default_value(1), "0 - high, 1 - normal, 2 - low")
+        ("deadline-us", po::value<int>(&config.deadline_us)->default_value(0), "Request deadline (0 - none)")
+        ("help", "Show all command")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << "\n";
+        return 1;
+    }
+
+    if (function == "sin") config.function = int(IpcFunction::Sin);
+    else if (function == "sqrt") config.function = int(IpcFunction::Sqrt);
+    else if (function == "pow") config.function = int(IpcFunction::Pow);
+    else if (function == "mix") config.function = -1;
+    else
+    {
+        std::cerr << "Unknown function: " << function << std::endl;
+        return 1;
+    }
+    if (config.connections < 1 || config.requests < 1 || config.batch < 1)
+    {
+        std::cerr << "--connections, --requests and --batch must be at least 1" << std::endl;
+        return 1;
+    }
+    // Запись блокирующая: при большей глубине сервер перестаёт читать раньше,
+    // чем поток дойдёт до чтения ответов
+    if (config.depth < 1 || config.depth > int(IPC_MAX_IN_FLIGHT))
+    {
+        std::cerr << "--depth must be between 1 and " << IPC_MAX_IN_FLIGHT << std::endl;
+        return 1;
+    }
+
+    std::vector<ConnectionStats> stats(config.connections);
+    auto begin = Clock::now();
+    {
+        std::vector<std::jthread> threads;
+        for (int i = 0; i < config.connections; ++i)
+        {
+            threads.emplace_back(run_connection, std::cref(config), i, std::ref(stats[i]));
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    std::vector<double> latencies;
+    size_t errors = 0;
+    size_t shed = 0;
+    for (const ConnectionStats& s : stats)
+    {
+        if (s.failed) return 1;
+        latencies.insert(latencies.end(), s.latencies.begin(), s.latencies.end());
+        errors += s.errors;
+        shed += s.shed;
+    }
+    if (latencies.empty())
+    {
+        std::cerr << "No requests were made" << std::endl;
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))]; };
+
+    std::cout << "Connections: " << config.connections << "\tDepth: " << config.depth
+              << "\tBatch: " << config.batch << std::endl;
+    std::cout << "Requests: " << latencies.size() << "\tThe time: " << seconds * 1000.0 << " ms"
+              << "\tRequests/s: " << latencies.size() / seconds << std::endl;
+    std::cout << "Latency, us: p50 " << percentile(0.50) << "\tp99 " << percentile(0.99)
+              << "\tmax " << latencies.back() << std::endl;
+    std::cout << "Wrong answers: " << errors << "\tShed: " << shed << std::endl;
+
+    return errors == 0 ? 0 : 1;
+}
@@ -1,81 +1,226 @@
 #include <iostream>
 #include <cmath>
 #include <chrono>
-#include <memory>
 #include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
 
-#define arr_elem 20000
-#define numThreads 16
+#include "../Common/run_config.hpp"
+#include "../Common/aligned_buffer.hpp"
+#include "../Common/multi_rhs.hpp"
+#include "../Common/lazy_vector.hpp"
+#include "../Common/profile.hpp"
+#include "../Common/perf_counters.hpp"
 
-std::shared_ptr<double[]> matrix(new double[arr_elem * arr_elem]);
-std::shared_ptr<double[]> vector(new double[arr_elem]);
-std::shared_ptr<double[]> answer(new double[arr_elem]);
-
-void multiply (int start, int end)
+template <typename T>
+struct Problem
 {
-    for (int i = start; i < end; i++) 
+    int arr_elem;
+    AlignedBuffer<T> matrix;
+    AlignedBuffer<T> vector;
+    AlignedBuffer<T> answer;
+
+    // Страницы распределяются по узлам при init_matrix/init_vector
+    // с тем же разбиением строк, что и в multiply
+    explicit Problem(int size)
+        : arr_elem(size),
+          matrix(size_t(size) * size),
+          vector(size),
+          answer(size) {}
+
+    void multiply(int start, int end)
     {
-        for (int j = 0; j < arr_elem; j++) 
+        for (int i = start; i < end; i++) 
         {
-            answer[i] += matrix[i * arr_elem + j] * vector[j];
+            T sum = 0;
+            for (int j = 0; j < arr_elem; j++) 
+            {
+                sum += matrix[size_t(i) * arr_elem + j] * vector[j];
+            }
+            answer[i] = sum;
         }
     }
-}
 
-void init_matrix(int start, int end)
-{
-    for (int i = start; i < end; ++i)
+    void init_matrix(int start, int end)
     {
-        matrix[i] = (i % (arr_elem + 1) == 0) ? 2.0 : 1.0;
+        for (int i = start; i < end; ++i)
+        {
+            for (int j = 0; j < arr_elem; ++j)
+            {
+                matrix[size_t(i) * arr_elem + j] = (i == j) ? 2.0 : 1.0;
+            }
+        }
     }
-}
 
-void init_vector(int start, int end)
+    void init_vector(int start, int end)
+    {
+        lazy::assign(vector.get(), lazy::iota<T>(arr_elem) + 1.0, start, end);
+    }
+};
+
+// Раздаёт строки потокам: static - равными интервалами, dynamic - порциями по chunk строк
+template <class F>
+void run_rows(const RunConfig& config, int numThreads, int rows, F&& body)
 {
-    for (int i = start; i < end; ++i)
+    // next объявлен до threads: jthread присоединяются в деструкторе раньше, чем он разрушится
+    std::atomic<int> next{0};
+    std::vector<std::jthread> threads;
+    threads.reserve(numThreads);
+
+    if (config.schedule == "dynamic")
+    {
+        int chunk = std::max(config.chunk, 1);
+        for (int i = 0; i < numThreads; ++i)
+        {
+            threads.emplace_back([&]() {
+                for (int start = next.fetch_add(chunk); start < rows; start = next.fetch_add(chunk))
+                {
+                    body(start, std::min(start + chunk, rows));
+                }
+            });
+        }
+        return;
+    }
+
+    int size = rows / numThreads;
+    for (int i = 0; i < numThreads; ++i) 
     {
-        vector[i] = double(i) + 1.0;
+        int start_interval = i * size;
+        int end_interval = (i == numThreads - 1) ? rows : (i + 1) * size;
+        threads.emplace_back(body, start_interval, end_interval);
     }
 }
 
-int main(int argc, char const* argv[])
+template <typename T>
+double matrix_product(const RunConfig& config, int arr_elem, int numThreads)
 {
+    Problem<T> problem(arr_elem);
+
     auto begin = std::chrono::steady_clock::now();
-    
-    std::jthread threads[numThreads];
 
-    int size = arr_elem / numThreads;
+    {
+        PROFILE_RANGE("init");
+        run_rows(config, numThreads, arr_elem, [&](int start, int end) { problem.init_matrix(start, end); });
+        run_rows(config, numThreads, arr_elem, [&](int start, int end) { problem.init_vector(start, end); });
+    }
+    {
+        // Модель: матрица читается один раз, 2 операции на элемент
+        PERF_KERNEL("matvec", double(arr_elem) * arr_elem * sizeof(T), 2.0 * arr_elem * arr_elem);
+        run_rows(config, numThreads, arr_elem, [&](int start, int end) {
+            PROFILE_RANGE("matvec");
+            problem.multiply(start, end);
+        });
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+// Y = A X для k векторов за один проход по матрице; время - упаковка и умножение
+template <typename T>
+double matrix_product_multi(const RunConfig& config, const Problem<T>& problem, int k, int numThreads, double& error)
+{
+    const int arr_elem = problem.arr_elem;
+    AlignedBuffer<T> vectors(size_t(k) * arr_elem);
+    AlignedBuffer<T> packed(size_t(k) * arr_elem);
+    AlignedBuffer<T> answer(size_t(k) * arr_elem);
 
-    for (int i = 0; i < numThreads; ++i) // matrix init
+    for (int v = 0; v < k; v++)
     {
-        int start_interval = i * size * arr_elem;
-        int end_interval = (i == numThreads - 1) ? arr_elem * arr_elem : (i + 1) * size * arr_elem;
-        threads[i] = std::jthread(init_matrix, start_interval, end_interval);
+        lazy::assign(vectors.get() + size_t(v) * arr_elem, lazy::iota<T>(arr_elem) + (1.0 + v), 0, arr_elem);
     }
 
-    for (int i = 0; i < numThreads; ++i) // vector init 
+    auto begin = std::chrono::steady_clock::now();
+
+    run_rows(config, numThreads, arr_elem, [&](int start, int end) {
+        packRhs(vectors.get(), packed.get(), arr_elem, k, start, end);
+    });
     {
-        int start_interval = i * size;
-        int end_interval = (i == numThreads - 1) ? arr_elem : (i + 1) * size;
-        threads[i] = std::jthread(init_vector, start_interval, end_interval);
+        // Модель: матрица читается один раз, 2k операции на элемент
+        PERF_KERNEL("matvec_multi", double(arr_elem) * arr_elem * sizeof(T), 2.0 * arr_elem * arr_elem * k);
+        run_rows(config, numThreads, arr_elem, [&](int start, int end) {
+            PROFILE_RANGE("matvec_multi");
+            multiRhsRows(problem.matrix.get(), packed.get(), answer.get(), arr_elem, k, start, end);
+        });
     }
 
-    for (int i = 0; i < numThreads; ++i) 
+    auto end = std::chrono::steady_clock::now();
+
+    error = multiRhsMaxError(answer.get(), arr_elem, k);
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+// Матрица заполняется один раз на размер, затем умножается на 1, 2, ... k векторов
+template <typename T>
+void multi_rhs_sweep(const RunConfig& config, const std::vector<int>& rhs)
+{
+    for (int numThreads : config.threads)
     {
-        int start_interval = i * size;
-        int end_interval = (i == numThreads - 1) ? arr_elem : (i + 1) * size;
-        threads[i] = std::jthread(multiply, start_interval, end_interval);
+        int size = config.scaledSize(numThreads, 2);
+        Problem<T> problem(size);
+        run_rows(config, numThreads, size, [&](int start, int end) { problem.init_matrix(start, end); });
+
+        MultiRhsReport report(numThreads, size);
+        for (int k : rhs)
+        {
+            double error = 0;
+            double seconds = matrix_product_multi<T>(config, problem, k, numThreads, error);
+            report.add(k, size, seconds, error);
+        }
     }
+}
 
-    for (int i = 0; i < numThreads; ++i) 
+int main(int argc, char const* argv[])
+{
+    RunConfig config;
+    po::options_description desc("options");
+    addRunOptions(desc, config, 20000, 16);
+    desc.add_options()
+        ("rhs", po::value<std::vector<int>>()->multitoken(),
+            "Multiply by several vectors per matrix pass, e.g. --rhs 1 2 4 8 16 32 64")
+    ;
+
+    po::variables_map vm;
+    if (!parseRunOptions(argc, argv, desc, vm)) return 1;
+
+    // k задаёт ширину панели правых частей и делитель в размере блока
+    if (vm.count("rhs"))
     {
-        threads[i].join();
+        for (int k : vm["rhs"].as<std::vector<int>>())
+        {
+            if (k < 1)
+            {
+                std::cerr << "--rhs values must be at least 1" << std::endl;
+                return 1;
+            }
+        }
     }
 
-    auto end = std::chrono::steady_clock::now();
-    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin);
+    if (config.schedule != "static" && config.schedule != "dynamic")
+    {
+        std::cerr << "Only static and dynamic schedules are supported" << std::endl;
+        return 1;
+    }
 
-    std::cout << "The time: " << elapsed_ms.count() << " ms\n";
+    return dispatchPrecision(config, [&]<typename T>() {
+        if (vm.count("rhs"))
+        {
+            multi_rhs_sweep<T>(config, vm["rhs"].as<std::vector<int>>());
+            PROFILE_REPORT();
+            PERF_REPORT();
+            return 0;
+        }
 
-    return 0;
-}
\ No newline at end of file
+        ScalingReport report(config);
+        for (int numThreads : config.threads)
+        {
+            int size = config.scaledSize(numThreads, 2);
+            report.add(numThreads, size, matrix_product<T>(config, size, numThreads));
+        }
+        PROFILE_REPORT();
+        PERF_REPORT();
+        return 0;
+    });
+}
@@ -8,6 +8,20 @@
 #include <random>
 #include <cmath> 
 #include <unordered_map>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <boost/program_options.hpp>
+
+#include "../Common/profile.hpp"
+#include "memo_cache.hpp"
+#include "socket_front.hpp"
+
+namespace po = boost::program_options;
 
 template<typename T>
 std::pair<T, T> fun_sin(T arg) 
@@ -27,13 +41,37 @@ std::pair<T, T> fun_pow(T arg)
     return { arg, std::pow(arg, 2.0) };
 }
 
+// Классы приоритета: задача класса ниже берётся, только если выше пусто
+enum class Priority { High, Normal, Low };
+constexpr int PRIORITIES = 3;
+
+// Что делать с задачей, срок которой истёк до начала выполнения:
+// Shed - не считать (результат {arg, NaN}), Demote - перевести в класс Low без срока
+enum class DeadlinePolicy { Shed, Demote };
+
+using Clock = std::chrono::steady_clock;
+
+// Повторные запросы (та же функция, тот же аргумент) при включённом кэше
+// отвечаются сразу в add_task, минуя очередь и рабочие потоки. Кэшируются задачи,
+// заданные указателем на функцию (fun_sin<double> и т.п.).
+//
+// Внутри класса приоритета клиенты обслуживаются по deficit round robin:
+// клиент на очереди получает квант (вес, по умолчанию 1) и тратит по единице на задачу,
+// затем уходит в конец круга. Поток дешёвых запросов одного клиента не задерживает
+// остальных дольше, чем на свой квант.
 template <typename T>
 class Server {
 public:
-    void start() 
+    using priority_type = Priority;
+    static constexpr int priorities = PRIORITIES;
+
+    void start(int workers = 1) 
     {
         stoken_ = false;
-        server_thread_ = std::thread(&Server::server_thread, this);
+        for (int i = 0; i < workers; ++i)
+        {
+            server_threads_.emplace_back(&Server::server_thread, this);
+        }
     }
 
     void stop() 
@@ -42,50 +80,254 @@ public:
             std::lock_guard<std::mutex> lock(mutex_);
             stoken_ = true;
         }
-        server_thread_.join();
+        work_ready_.notify_all();
+        for (std::thread& thread : server_threads_)
+        {
+            thread.join();
+        }
+        server_threads_.clear();
     }
 
-    size_t add_task(std::function<std::pair<T,T>(T)> task) 
+    // Аргумент - случайный из [1, 10); deadline - срок от момента постановки, ноль - без срока
+    size_t add_task(std::function<std::pair<T,T>(T)> task, size_t client = 0,
+                    Priority priority = Priority::Normal, Clock::duration deadline = Clock::duration::zero()) 
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        static std::default_random_engine generator;
-        static std::uniform_real_distribution<T> distribution(1.0, 10.0);
-        tasks_.push({ ++next_id_, std::async(std::launch::deferred, task, distribution(generator)) });
-        return tasks_.back().first;
+        T arg;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            static std::default_random_engine generator;
+            static std::uniform_real_distribution<T> distribution(1.0, 10.0);
+            arg = distribution(generator);
+        }
+        return add_task_arg(std::move(task), arg, client, priority, deadline);
+    }
+
+    size_t add_task_arg(std::function<std::pair<T,T>(T)> task, T arg, size_t client = 0,
+                        Priority priority = Priority::Normal, Clock::duration deadline = Clock::duration::zero()) 
+    {
+        return enqueue(std::move(task), arg, client, priority, deadline, nullptr);
+    }
+
+    // Результат не попадает в results_, а передаётся done - в рабочем потоке,
+    // при попадании в кэш - сразу в вызывающем
+    size_t add_task_async(std::function<std::pair<T,T>(T)> task, T arg, size_t client, Priority priority,
+                          Clock::duration deadline, std::function<void(const std::pair<T,T>&)> done) 
+    {
+        return enqueue(std::move(task), arg, client, priority, deadline, std::move(done));
     }
 
     std::pair<T, T> request_result(size_t id) 
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        while (results_.find(id) == results_.end()) {} // Ожидание результата
+        PROFILE_RANGE("request_result");
+        std::unique_lock<std::mutex> lock(mutex_);
+        results_ready_.wait(lock, [&]() { return results_.find(id) != results_.end(); });
         auto result = results_[id];
         results_.erase(id);
         return result;
     }
 
+    void set_client_weight(size_t client, int weight)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        weights_[client] = std::max(weight, 1);
+    }
+
+    void set_deadline_policy(DeadlinePolicy policy)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        policy_ = policy;
+    }
+
+    // Включает кэш результатов на capacity записей; вызывать до start()
+    void enable_cache(size_t capacity, size_t shards = 16)
+    {
+        cache_ = std::make_unique<MemoCache<T>>(capacity, shards);
+    }
+
+    const MemoCache<T>* cache() const { return cache_.get(); }
+
+    size_t shed() const { return shed_; }
+    size_t demoted() const { return demoted_; }
+
 private:
+    struct Task
+    {
+        size_t id;
+        size_t client;
+        Priority priority;
+        std::function<std::pair<T,T>(T)> function;
+        T arg;
+        bool has_deadline;
+        Clock::time_point deadline;
+        bool cacheable;
+        typename MemoCache<T>::Key key;
+        std::function<void(const std::pair<T,T>&)> done;
+    };
+
+    struct ClientQueue
+    {
+        std::deque<Task> tasks;
+        int deficit = 0;
+    };
+
+    struct PriorityClass
+    {
+        std::unordered_map<size_t, ClientQueue> clients;
+        std::deque<size_t> active; // клиенты с непустой очередью, в порядке круга
+        size_t size = 0;
+    };
+
     std::mutex mutex_;
-    std::thread server_thread_;
+    std::condition_variable work_ready_;
+    std::condition_variable results_ready_;
+    std::vector<std::thread> server_threads_;
     bool stoken_ = false;
     size_t next_id_ = 1;
-    std::queue<std::pair<size_t, std::future<std::pair<T,T>>>> tasks_;
+    size_t queued_ = 0;
+    PriorityClass classes_[PRIORITIES];
+    std::unordered_map<size_t, int> weights_;
+    DeadlinePolicy policy_ = DeadlinePolicy::Shed;
+    std::atomic<size_t> shed_{0};
+    std::atomic<size_t> demoted_{0};
     std::unordered_map<size_t, std::pair<T,T>> results_;
+    std::unique_ptr<MemoCache<T>> cache_;
+
+    size_t enqueue(std::function<std::pair<T,T>(T)> task, T arg, size_t client, Priority priority,
+                   Clock::duration deadline, std::function<void(const std::pair<T,T>&)> done) 
+    {
+        PROFILE_RANGE("add_task");
+        auto* function = task.template target<std::pair<T,T>(*)(T)>();
+        typename MemoCache<T>::Key key{ function ? std::uintptr_t(*function) : 0, arg };
+        bool cacheable = cache_ && function;
+
+        std::pair<T, T> cached;
+        if (cacheable && cache_->lookup(key, cached))
+        {
+            size_t id;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                id = next_id_++;
+                if (!done) results_[id] = cached;
+            }
+            if (done) done(cached);
+            else results_ready_.notify_all();
+            return id;
+        }
+
+        size_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            id = next_id_++;
+            Task entry{ id, client, priority, std::move(task), arg,
+                        deadline > Clock::duration::zero(), Clock::now() + deadline, cacheable, key, std::move(done) };
+            push(std::move(entry));
+            PROFILE_COUNTER("queue", queued_);
+        }
+        work_ready_.notify_one();
+        return id;
+    }
+
+    // Вызывается под mutex_
+    void push(Task task)
+    {
+        PriorityClass& c = classes_[int(task.priority)];
+        ClientQueue& queue = c.clients[task.client];
+        if (queue.tasks.empty())
+        {
+            c.active.push_back(task.client);
+        }
+        queue.tasks.push_back(std::move(task));
+        c.size++;
+        queued_++;
+    }
+
+    int weight(size_t client) const
+    {
+        auto it = weights_.find(client);
+        return it == weights_.end() ? 1 : it->second;
+    }
+
+    // Следующая задача по приоритету и DRR; вызывается под mutex_ при queued_ > 0
+    Task pop()
+    {
+        PriorityClass* c = classes_;
+        while (c->size == 0) ++c;
+
+        while (true)
+        {
+            size_t client = c->active.front();
+            ClientQueue& queue = c->clients[client];
+            if (queue.deficit > 0)
+            {
+                Task task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                queue.deficit--;
+                if (queue.tasks.empty())
+                {
+                    // Выбывший из круга клиент не копит кредит и не занимает место:
+                    // очередь заводится заново при следующей задаче
+                    c->active.pop_front();
+                    c->clients.erase(client);
+                }
+                c->size--;
+                queued_--;
+                return task;
+            }
+            c->active.pop_front();
+            c->active.push_back(client);
+            queue.deficit += weight(client);
+        }
+    }
 
     void server_thread() 
     {
         while (true) 
         {
-            std::lock_guard<std::mutex> lock(mutex_);
-            if (tasks_.empty() && stoken_) 
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_ready_.wait(lock, [&]() { return queued_ > 0 || stoken_; });
+            if (queued_ == 0 && stoken_) 
             {
                 break;
             }
-            if (!tasks_.empty()) 
+
+            Task task = pop();
+            // Политика читается под блокировкой: set_deadline_policy меняет её на ходу
+            bool expired = task.has_deadline && Clock::now() > task.deadline;
+            bool shed = expired && policy_ == DeadlinePolicy::Shed;
+            if (expired && policy_ == DeadlinePolicy::Demote && task.priority != Priority::Low)
+            {
+                task.priority = Priority::Low;
+                task.has_deadline = false;
+                push(std::move(task));
+                demoted_++;
+                continue;
+            }
+            lock.unlock();
+
+            // Задача считается без блокировки: клиенты тем временем ставят новые
+            std::pair<T, T> result;
+            if (shed)
+            {
+                result = { task.arg, std::numeric_limits<T>::quiet_NaN() };
+                shed_++;
+            }
+            else
             {
-                auto task = std::move(tasks_.front());
-                tasks_.pop();
-                results_[task.first] = task.second.get();
+                PROFILE_RANGE("task");
+                result = task.function(task.arg);
+                if (task.cacheable) cache_->insert(task.key, result);
             }
+
+            if (task.done)
+            {
+                task.done(result);
+                continue;
+            }
+
+            lock.lock();
+            results_[task.id] = result;
+            lock.unlock();
+            results_ready_.notify_all();
         }
     }
 };
@@ -94,11 +336,13 @@ private:
 template <typename T>
 class Client {
 public:
+    explicit Client(size_t id = 0, Priority priority = Priority::Normal) : id_(id), priority_(priority) {}
+
     void run_client(Server<T>& server, std::function<std::pair<T,T>(T)> task) 
     {
         for (int i = 0; i < 5; ++i)
         {
-            task_ids_.emplace_back(server.add_task(task));
+            task_ids_.emplace_back(server.add_task(task, id_, priority_));
         }
         
     }
@@ -106,7 +350,7 @@ public:
     std::vector<std::pair<T, T>> client_to_result(Server<T>& server) 
     {
         std::vector<std::pair<T, T>> results;
-        for (int id : task_ids_) 
+        for (size_t id : task_ids_) 
         {
             results.emplace_back(server.request_result(id));
         }
@@ -114,19 +358,204 @@ public:
     }
 
 private:
-    std::vector<int> task_ids_;
+    size_t id_;
+    Priority priority_;
+    std::vector<size_t> task_ids_;
 };
 
 
-int main() {
+struct BenchConfig
+{
+    std::string mode;
+    int probes;
+    int window;
+    int deadline_us;
+    DeadlinePolicy policy;
+    int workers;
+    size_t cache;
+    int keys;
+};
+
+void print_cache_stats(const Server<double>& server)
+{
+    const MemoCache<double>* cache = server.cache();
+    if (!cache) return;
+    size_t lookups = cache->hits() + cache->misses();
+    std::cout << "Cache: hits " << cache->hits() << "\tmisses " << cache->misses()
+              << "\thit rate " << (lookups ? double(cache->hits()) / lookups : 0.0)
+              << "\tevictions " << cache->evictions() << std::endl;
+}
+
+// Задержка запросов одного клиента, пока другой держит в очереди сервера window задач.
+// mode: fifo - оба клиента как один (прежняя очередь), fair - разные клиенты одного
+// класса (DRR), priority - замеряемый клиент в классе High.
+// При keys > 0 аргументы берутся из keys повторяющихся значений - так, как их видит кэш.
+int run_benchmark(const BenchConfig& config)
+{
+    const size_t flooder = 1;
+    const size_t prober = (config.mode == "fifo") ? flooder : 2;
+    const Priority probe_priority = (config.mode == "priority") ? Priority::High : Priority::Normal;
+    const int probes = config.probes;
+    const int window = config.window;
+    const int deadline_us = config.deadline_us;
+
+    Server<double> server;
+    server.set_deadline_policy(config.policy);
+    if (config.cache > 0) server.enable_cache(config.cache);
+    server.start(config.workers);
+
+    // Аргумент задачи: случайный из [1, 10) или одно из keys значений на том же отрезке
+    std::mutex keys_mutex;
+    std::mt19937 keys_generator(42);
+    auto submit = [&](std::pair<double, double> (*function)(double), size_t client, Priority priority,
+                      Clock::duration deadline) {
+        if (config.keys <= 0) return server.add_task(function, client, priority, deadline);
+        int key;
+        {
+            std::lock_guard<std::mutex> lock(keys_mutex);
+            key = std::uniform_int_distribution<int>(0, config.keys - 1)(keys_generator);
+        }
+        return server.add_task_arg(function, 1.0 + 9.0 * key / config.keys, client, priority, deadline);
+    };
+
+    std::atomic<bool> flooding{true};
+    std::atomic<size_t> flooded{0};
+    std::thread flood([&]() {
+        std::deque<size_t> outstanding;
+        while (flooding)
+        {
+            while (outstanding.size() < size_t(window))
+            {
+                outstanding.push_back(submit(fun_sin<double>, flooder, Priority::Normal,
+                                             std::chrono::microseconds(deadline_us)));
+            }
+            server.request_result(outstanding.front());
+            outstanding.pop_front();
+            flooded++;
+        }
+        for (size_t id : outstanding)
+        {
+            server.request_result(id);
+        }
+    });
+
+    // Очередь успевает заполниться до первых замеров
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto begin = Clock::now();
+    size_t flooded_begin = flooded;
+    std::vector<double> latencies;
+    for (int i = 0; i < probes; ++i)
+    {
+        auto start = Clock::now();
+        server.request_result(submit(fun_sqrt<double>, prober, probe_priority, Clock::duration::zero()));
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    size_t flood_done = flooded - flooded_begin;
+
+    flooding = false;
+    flood.join();
+    server.stop();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))]; };
+
+    std::cout << "Mode: " << config.mode << "\tWindow: " << window << "\tWorkers: " << config.workers << std::endl;
+    std::cout << "Probe latency, us: p50 " << percentile(0.50) << "\tp99 " << percentile(0.99)
+              << "\tmax " << latencies.back() << std::endl;
+    std::cout << "Background: " << flood_done / seconds << " tasks/s" << std::endl;
+    if (deadline_us > 0)
+    {
+        std::cout << "Deadline: " << deadline_us << " us\tShed: " << server.shed()
+                  << "\tDemoted: " << server.demoted() << std::endl;
+    }
+    print_cache_stats(server);
+    return 0;
+}
+
+int main(int argc, char const* argv[]) {
+    BenchConfig config;
+    std::string policy;
+    std::string socket_path;
+
+    po::options_description desc("options");
+    desc.add_options()
+        ("bench", "Measure probe latency while another client floods the server")
+        ("socket", po::value<std::string>(&socket_path), "Serve other processes on this Unix socket until SIGINT/SIGTERM")
+        ("mode", po::value<std::string>(&config.mode)->default_value("priority"), "fifo, fair or priority")
+        ("probes", po::value<int>(&config.probes)->default_value(2000), "Latency samples")
+        ("window", po::value<int>(&config.window)->default_value(10000), "Tasks the flooding client keeps queued")
+        ("deadline-us", po::value<int>(&config.deadline_us)->default_value(0), "Deadline of flooding tasks (0 - none)")
+        ("policy", po::value<std::string>(&policy)->default_value("shed"), "Expired tasks: shed or demote")
+        ("workers", po::value<int>(&config.workers)->default_value(1), "Server threads")
+        ("cache", po::value<size_t>(&config.cache)->default_value(0), "Result cache capacity (0 - off)")
+        ("keys", po::value<int>(&config.keys)->default_value(0), "Distinct arguments in the benchmark (0 - random)")
+        ("help", "Show all command")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << "\n";
+        return 1;
+    }
+
+    // Без рабочих потоков задачи никто не выполнит
+    if (config.workers < 1)
+    {
+        std::cerr << "--workers must be at least 1" << std::endl;
+        return 1;
+    }
+
+    if (vm.count("bench"))
+    {
+        if (config.probes < 1 || config.window < 1)
+        {
+            std::cerr << "--probes and --window must be at least 1" << std::endl;
+            return 1;
+        }
+        if ((config.mode != "fifo" && config.mode != "fair" && config.mode != "priority") ||
+            (policy != "shed" && policy != "demote"))
+        {
+            std::cerr << "Unknown mode or policy" << std::endl;
+            return 1;
+        }
+        config.policy = (policy == "shed") ? DeadlinePolicy::Shed : DeadlinePolicy::Demote;
+        return run_benchmark(config);
+    }
+
+    if (vm.count("socket"))
+    {
+        using FrontEnd = SocketFrontEnd<Server<double>, double>;
+        // Сигналы остановки блокируются до запуска рабочих потоков и приходят в signalfd
+        FrontEnd::block_stop_signals();
+
+        Server<double> server;
+        if (config.cache > 0) server.enable_cache(config.cache);
+        server.start(config.workers);
+
+        // Порядок - как у IpcFunction
+        FrontEnd front_end(server, { fun_sin<double>, fun_sqrt<double>, fun_pow<double> });
+        bool ok = front_end.run(socket_path);
+        server.stop();
+        print_cache_stats(server);
+        return ok ? 0 : 1;
+    }
+
     Server<double> server; 
-    server.start();
+    if (config.cache > 0) server.enable_cache(config.cache);
+    server.start(config.workers);
 
     auto begin = std::chrono::steady_clock::now();
 
-    Client<double> client1;
-    Client<double> client2;
-    Client<double> client3;
+    Client<double> client1(1);
+    Client<double> client2(2);
+    Client<double> client3(3);
 
     std::thread t1 ([&]() { client1.run_client(server, fun_sin<double>); });
     std::thread t2 ([&]() { client2.run_client(server, fun_sqrt<double>); });
@@ -154,6 +583,7 @@ int main() {
     auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin);
 
     std::cout << "The time: " << elapsed_ms.count() << " ms" << std::endl;
+    print_cache_stats(server);
     
     std::ofstream file;
 	file.open("answer.txt");
@@ -174,6 +604,7 @@ int main() {
     }
 
     file.close(); 
+    PROFILE_REPORT();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+// Двоичный протокол локального фронтенда сервера (Unix domain socket, SOCK_STREAM).
+// Кадры фиксированного размера в порядке байтов машины - клиент и сервер на одном узле.
+// Клиент может слать запросы подряд, не дожидаясь ответов, и сколько угодно кадров
+// одним write; сервер отвечает по мере готовности, в любом порядке - ответ находят по tag.
+// Задача, не уложившаяся в срок, и неизвестная функция дают value = NaN.
+
+// Сервер держит в работе не больше стольких запросов одного соединения и, дойдя
+// до предела, перестаёт читать сокет. Клиент, который пишет блокирующе и не читает
+// ответы во время записи, должен держать неотвеченных запросов не больше этого.
+constexpr uint32_t IPC_MAX_IN_FLIGHT = 4096;
+
+enum class IpcFunction : uint8_t { Sin, Sqrt, Pow, Count };
+
+struct RequestFrame
+{
+    uint64_t tag;         // возвращается в ответе как есть
+    double arg;
+    uint32_t deadline_us; // 0 - без срока
+    uint8_t function;     // IpcFunction
+    uint8_t priority;     // Priority: 0 - High, 1 - Normal, 2 - Low
+    uint16_t reserved;
+};
+
+struct ResponseFrame
+{
+    uint64_t tag;
+    double arg;
+    double value;
+};
+
+static_assert(sizeof(RequestFrame) == 24, "request frame layout");
+static_assert(sizeof(ResponseFrame) == 24, "response frame layout");
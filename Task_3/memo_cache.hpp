@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Кэш результатов по (функция, аргумент) ограниченного размера.
+// Ключи распределены по шардам по хэшу, у каждого шарда своя блокировка,
+// поэтому потоки, обращающиеся к разным ключам, почти не мешают друг другу.
+// Вытеснение - CLOCK: у записи бит обращения, стрелка идёт по кругу,
+// сбрасывая биты, и вытесняет первую запись без обращений с прошлого круга.
+template <typename T>
+class MemoCache {
+public:
+    using Value = std::pair<T, T>;
+
+    struct Key
+    {
+        std::uintptr_t function;
+        T arg;
+
+        // Аргументы сравниваются побитово: NaN != NaN, и запись с NaN-ключом
+        // иначе никогда не находилась бы в индексе и не удалялась из него
+        bool operator==(const Key& other) const
+        {
+            return function == other.function && std::memcmp(&arg, &other.arg, sizeof(T)) == 0;
+        }
+    };
+
+    MemoCache(size_t capacity, size_t shards = 16)
+        : shards_(std::max<size_t>(shards, 1))
+    {
+        size_t per_shard = std::max<size_t>((capacity + shards_.size() - 1) / shards_.size(), 1);
+        for (auto& shard : shards_)
+        {
+            shard = std::make_unique<Shard>();
+            shard->slots.resize(per_shard);
+            shard->index.reserve(per_shard);
+        }
+    }
+
+    bool lookup(const Key& key, Value& value)
+    {
+        Shard& shard = shard_for(key);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end())
+            {
+                Slot& slot = shard.slots[it->second];
+                slot.referenced = true;
+                value = slot.value;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void insert(const Key& key, const Value& value)
+    {
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            shard.slots[it->second].value = value;
+            return;
+        }
+
+        size_t victim;
+        if (shard.used < shard.slots.size())
+        {
+            victim = shard.used++;
+        }
+        else
+        {
+            while (shard.slots[shard.hand].referenced)
+            {
+                shard.slots[shard.hand].referenced = false;
+                shard.hand = (shard.hand + 1) % shard.slots.size();
+            }
+            victim = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.slots.size();
+            shard.index.erase(shard.slots[victim].key);
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        shard.slots[victim] = { key, value, false };
+        shard.index[key] = victim;
+    }
+
+    size_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    size_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    size_t evictions() const { return evictions_.load(std::memory_order_relaxed); }
+
+private:
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            // Хэш от битов - согласован с побитовым сравнением (0.0 и -0.0 различны)
+            uint64_t bits = 0;
+            std::memcpy(&bits, &key.arg, std::min(sizeof(T), sizeof(bits)));
+            size_t h = std::hash<uint64_t>()(bits);
+            return h ^ (std::hash<std::uintptr_t>()(key.function) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+        }
+    };
+
+    struct Slot
+    {
+        Key key{};
+        Value value{};
+        bool referenced = false;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<Slot> slots;
+        std::unordered_map<Key, size_t, KeyHash> index;
+        size_t used = 0;
+        size_t hand = 0;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+    std::atomic<size_t> evictions_{0};
+
+    Shard& shard_for(const Key& key)
+    {
+        // Старшие биты хэша: младшие заняты выбором корзины внутри шарда
+        size_t h = KeyHash()(key);
+        return *shards_[(h >> 32 ^ h >> 16) % shards_.size()];
+    }
+};
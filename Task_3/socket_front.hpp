@@ -0,0 +1,421 @@
+#pragma once
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ipc_protocol.hpp"
+
+// Фронтенд сервера для других процессов: один поток ввода-вывода на epoll
+// принимает соединения, разбирает кадры запросов и ставит задачи в очередь
+// сервера с обратным вызовом. Рабочие потоки кладут готовые ответы в общую
+// очередь и будят поток ввода-вывода через eventfd (только если очередь была пуста),
+// он дописывает ответы в выходные буферы соединений. Сокеты неблокирующие.
+// Каждое соединение - отдельный клиент для DRR сервера.
+//
+// Обратное давление: соединение, у которого в работе MAX_IN_FLIGHT запросов или
+// в выходном буфере MAX_OUT_BYTES неотправленных ответов, перестаёт читаться
+// (EPOLLIN снимается), необработанные кадры ждут во входном буфере не больше
+// READ_BUDGET байт. Чтение возобновляется, когда ответы доставлены и отправлены.
+// За одно событие из соединения читается не больше READ_BUDGET байт - epoll
+// работает по уровню, остаток дочитывается на следующем круге после остальных.
+//
+// Клиент может закрыть свою сторону на запись (shutdown(SHUT_WR)) сразу после
+// пачки запросов: соединение перестаёт читаться, но закрывается, только когда
+// все его задачи выполнены и ответы отправлены.
+//
+// Работает до SIGINT/SIGTERM; block_stop_signals() нужно вызвать до запуска
+// рабочих потоков сервера, чтобы сигнал доставлялся в signalfd.
+template <class ServerT, typename T>
+class SocketFrontEnd {
+public:
+    using Function = std::pair<T, T> (*)(T);
+
+    SocketFrontEnd(ServerT& server, std::vector<Function> functions)
+        : server_(server), functions_(std::move(functions)) {}
+
+    static void block_stop_signals()
+    {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    }
+
+    // false - не удалось открыть сокет
+    bool run(const std::string& path)
+    {
+        if (!open(path))
+        {
+            close_all(path);
+            return false;
+        }
+        std::cout << "Listening on " << path << std::endl;
+
+        epoll_event events[64];
+        bool stop = false;
+        while (!stop)
+        {
+            int count = epoll_wait(epoll_fd_, events, 64, -1);
+            if (count < 0 && errno != EINTR)
+            {
+                std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            for (int i = 0; i < count; ++i)
+            {
+                uint64_t key = events[i].data.u64;
+                if (key == LISTEN_KEY) accept_all();
+                else if (key == WAKE_KEY) deliver_completions();
+                else if (key == SIGNAL_KEY) stop = true;
+                else handle(key, events[i].events);
+            }
+        }
+
+        std::cout << "Connections: " << accepted_ << "\tRequests: " << requests_
+                  << "\tResponses: " << responses_ << std::endl;
+        close_all(path);
+        return true;
+    }
+
+private:
+    static constexpr uint64_t LISTEN_KEY = 0;
+    static constexpr uint64_t WAKE_KEY = 1;
+    static constexpr uint64_t SIGNAL_KEY = 2;
+    static constexpr uint64_t FIRST_CONNECTION = 16;
+    static constexpr size_t MAX_IN_FLIGHT = IPC_MAX_IN_FLIGHT;
+    static constexpr size_t MAX_OUT_BYTES = size_t(1) << 20;
+    static constexpr size_t READ_BUDGET = size_t(256) << 10;
+    static constexpr uint32_t READ_EVENTS = uint32_t(EPOLLIN) | uint32_t(EPOLLRDHUP);
+
+    struct Connection
+    {
+        int fd;
+        std::vector<char> in;
+        std::vector<char> out;
+        size_t out_offset = 0;
+        size_t in_flight = 0;
+        uint32_t events = 0; // текущая подписка epoll
+        bool eof = false;    // клиент больше не пишет
+    };
+
+    struct Completion
+    {
+        uint64_t connection;
+        ResponseFrame frame;
+    };
+
+    ServerT& server_;
+    std::vector<Function> functions_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    int signal_fd_ = -1;
+    uint64_t next_connection_ = FIRST_CONNECTION;
+    std::unordered_map<uint64_t, Connection> connections_;
+    size_t accepted_ = 0;
+    size_t requests_ = 0;
+    size_t responses_ = 0;
+
+    std::mutex completions_mutex_;
+    std::vector<Completion> completions_;
+
+    bool fail(const char* what)
+    {
+        std::cerr << what << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    bool watch(int fd, uint64_t key, uint32_t events)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = key;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    bool open(const std::string& path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            std::cerr << "Socket path is too long: " << path << std::endl;
+            return false;
+        }
+        std::strcpy(address.sun_path, path.c_str());
+        unlink(path.c_str());
+
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) return fail("socket");
+        if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) return fail("bind");
+        if (listen(listen_fd_, 128) < 0) return fail("listen");
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        signal_fd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (epoll_fd_ < 0 || wake_fd_ < 0 || signal_fd_ < 0) return fail("epoll/eventfd/signalfd");
+
+        if (!watch(listen_fd_, LISTEN_KEY, EPOLLIN) || !watch(wake_fd_, WAKE_KEY, EPOLLIN) ||
+            !watch(signal_fd_, SIGNAL_KEY, EPOLLIN))
+        {
+            return fail("epoll_ctl");
+        }
+        return true;
+    }
+
+    void close_all(const std::string& path)
+    {
+        for (auto& [key, connection] : connections_)
+        {
+            close(connection.fd);
+        }
+        connections_.clear();
+        for (int* fd : { &listen_fd_, &epoll_fd_, &wake_fd_, &signal_fd_ })
+        {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+        unlink(path.c_str());
+    }
+
+    void accept_all()
+    {
+        while (true)
+        {
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            uint64_t key = next_connection_++;
+            if (!watch(fd, key, READ_EVENTS))
+            {
+                close(fd);
+                continue;
+            }
+            Connection& connection = connections_[key];
+            connection.fd = fd;
+            connection.events = READ_EVENTS;
+            accepted_++;
+        }
+    }
+
+    void drop(uint64_t key)
+    {
+        auto it = connections_.find(key);
+        if (it == connections_.end()) return;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        close(it->second.fd);
+        connections_.erase(it);
+    }
+
+    void handle(uint64_t key, uint32_t events)
+    {
+        auto it = connections_.find(key);
+        if (it == connections_.end()) return;
+        Connection& connection = it->second;
+
+        // Клиент закрыл сокет целиком - ответы доставлять некуда
+        if (events & (EPOLLHUP | EPOLLERR))
+        {
+            drop(key);
+            return;
+        }
+        if (events & EPOLLOUT)
+        {
+            if (!flush(key, connection)) return;
+        }
+        if ((events & (EPOLLIN | EPOLLRDHUP)) && !connection.eof)
+        {
+            char buffer[64 * 1024];
+            size_t budget = READ_BUDGET;
+            while (budget > 0 && connection.in.size() < READ_BUDGET)
+            {
+                ssize_t n = read(connection.fd, buffer, std::min(sizeof(buffer), budget));
+                if (n > 0)
+                {
+                    connection.in.insert(connection.in.end(), buffer, buffer + n);
+                    budget -= n;
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (n < 0)
+                {
+                    drop(key);
+                    return;
+                }
+                // Конец потока запросов; ответы на уже принятые ещё нужны клиенту
+                connection.eof = true;
+                break;
+            }
+        }
+        parse(key, connection);
+        if (flush(key, connection)) settle(key, connection);
+    }
+
+    // После записи: закрывает дочитанное и отвеченное соединение, иначе обновляет подписку
+    void settle(uint64_t key, Connection& connection)
+    {
+        if (connection.eof && connection.in_flight == 0 && connection.out_offset == connection.out.size() &&
+            connection.in.size() < sizeof(RequestFrame))
+        {
+            drop(key);
+            return;
+        }
+        update_events(key, connection);
+    }
+
+    bool accepting(const Connection& connection) const
+    {
+        return connection.in_flight < MAX_IN_FLIGHT &&
+               connection.out.size() - connection.out_offset < MAX_OUT_BYTES;
+    }
+
+    // Ставит в очередь целые кадры входного буфера, пока соединение не упрётся в пределы
+    void parse(uint64_t key, Connection& connection)
+    {
+        size_t frames = connection.in.size() / sizeof(RequestFrame);
+        size_t done = 0;
+        for (; done < frames && accepting(connection); ++done)
+        {
+            RequestFrame request;
+            std::memcpy(&request, connection.in.data() + done * sizeof(RequestFrame), sizeof(RequestFrame));
+            requests_++;
+
+            if (request.function >= functions_.size() || request.priority >= ServerT::priorities)
+            {
+                append(connection, { request.tag, request.arg, std::numeric_limits<double>::quiet_NaN() });
+                continue;
+            }
+
+            uint64_t tag = request.tag;
+            connection.in_flight++;
+            server_.add_task_async(functions_[request.function], T(request.arg), key,
+                                   typename ServerT::priority_type(request.priority),
+                                   std::chrono::microseconds(request.deadline_us),
+                                   [this, key, tag](const std::pair<T, T>& result) {
+                                       complete({ key, { tag, double(result.first), double(result.second) } });
+                                   });
+        }
+        connection.in.erase(connection.in.begin(), connection.in.begin() + done * sizeof(RequestFrame));
+    }
+
+    // Вызывается рабочими потоками сервера
+    void complete(const Completion& completion)
+    {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(completions_mutex_);
+            wake = completions_.empty();
+            completions_.push_back(completion);
+        }
+        if (wake)
+        {
+            uint64_t one = 1;
+            ssize_t written = write(wake_fd_, &one, sizeof(one));
+            (void)written;
+        }
+    }
+
+    void deliver_completions()
+    {
+        uint64_t counter;
+        ssize_t got = read(wake_fd_, &counter, sizeof(counter));
+        (void)got;
+
+        std::vector<Completion> ready;
+        {
+            std::lock_guard<std::mutex> lock(completions_mutex_);
+            ready.swap(completions_);
+        }
+
+        std::vector<uint64_t> touched;
+        for (const Completion& completion : ready)
+        {
+            auto it = connections_.find(completion.connection);
+            if (it == connections_.end()) continue;
+            it->second.in_flight--;
+            append(it->second, completion.frame);
+            touched.push_back(completion.connection);
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+        // Один write на соединение за пачку ответов; освободившееся место -
+        // под отложенные кадры и чтение
+        for (uint64_t key : touched)
+        {
+            auto it = connections_.find(key);
+            if (it == connections_.end() || !flush(key, it->second)) continue;
+            parse(key, it->second);
+            if (flush(key, it->second)) settle(key, it->second);
+        }
+    }
+
+    void append(Connection& connection, const ResponseFrame& frame)
+    {
+        const char* bytes = reinterpret_cast<const char*>(&frame);
+        connection.out.insert(connection.out.end(), bytes, bytes + sizeof(frame));
+        responses_++;
+    }
+
+    // false - соединение закрыто
+    bool flush(uint64_t key, Connection& connection)
+    {
+        while (connection.out_offset < connection.out.size())
+        {
+            // MSG_NOSIGNAL: клиент, закрывший сокет, не должен ронять сервер SIGPIPE
+            ssize_t n = send(connection.fd, connection.out.data() + connection.out_offset,
+                             connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                connection.out_offset += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            drop(key);
+            return false;
+        }
+        connection.out.clear();
+        connection.out_offset = 0;
+        return true;
+    }
+
+    // EPOLLOUT - пока есть неотправленное, EPOLLIN - пока соединение принимает запросы
+    // и клиент не закрыл запись (иначе конец потока сообщался бы на каждом круге)
+    void update_events(uint64_t key, Connection& connection)
+    {
+        uint32_t events = 0;
+        if (!connection.eof && accepting(connection) && connection.in.size() < READ_BUDGET) events |= READ_EVENTS;
+        if (connection.out_offset < connection.out.size()) events |= uint32_t(EPOLLOUT);
+        if (events == connection.events) return;
+
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = key;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+};
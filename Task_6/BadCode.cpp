@@ -8,11 +8,10 @@
 #ifdef OPENACC__
 #include <openacc.h>
 #endif
-#ifdef NVPROF_
-#include </opt/nvidia/hpc_sdk/Linux_x86_64/23.11/cuda/12.3/include/nvtx3/nvToolsExt.h>
-#endif
 #include <omp.h>
 
+#include "../Common/profile.hpp"
+
 #define at(arr, x, y) (arr[(x) * size + (y)])
 #define size_sq size * size
 
@@ -109,9 +108,7 @@ int main(int argc, char *argv[])
 
 #pragma acc enter data copyin(Fnew[:size_sq], F[:size_sq], error)
 
-#ifdef NVPROF_
-    nvtxRangePush("MainCycle");
-#endif
+    { PROFILE_RANGE("MainCycle");
     do
     {
         #pragma acc parallel present(error) async
@@ -156,9 +153,7 @@ int main(int argc, char *argv[])
         iteration++;
         itersBetweenUpdate++;
     } while (iteration < iterations && error > eps);
-#ifdef NVPROF_
-    nvtxRangePop();
-#endif
+    }
 
     #pragma acc parallel loop collapse(2) present(Fnew[:size_sq], F[:size_sq], error) reduction(max:error) vector_length(128) async
     for (int x = 1; x < size - 1; x++)
@@ -176,6 +171,7 @@ int main(int argc, char *argv[])
     std::cout << "Iterations: " << iteration << std::endl;
     std::cout << "Error: " << error << std::endl;
     if (showResult) saveMatrix(F, size, "matrix.txt");
+    PROFILE_REPORT();
 
     delete[] F;
     delete[] Fnew;
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cmath>
+#include <omp.h>
+
+#include "../Common/aligned_buffer.hpp"
+#include "../Common/convergence_monitor.hpp"
+#include "../Common/stencil.hpp"
+#include "../Common/profile.hpp"
+
+// Пакетный режим: много независимых небольших задач (64^2 - 512^2) в одном процессе.
+// Одна задача решается целиком одним потоком - на малых сетках это выгоднее,
+// чем делить каждую сетку между всеми ядрами. Задачи раздаются потокам
+// динамически, от больших к меньшим; буферы сеток берутся из пула и
+// переиспользуются; строка результата пишется сразу по окончании задачи.
+//
+// Файл задач - по строке на задачу ('#' - комментарий):
+//   size leftUp rightUp leftDown rightDown [eps [iterations]]
+
+struct BatchProblem
+{
+    int id;
+    int size;
+    double corners[4]; // leftUp, rightUp, leftDown, rightDown
+    double eps;
+    int iterations;
+};
+
+struct BatchResult
+{
+    int iterations;
+    double error;
+    double seconds;
+};
+
+// Число из токена целиком: "1e-6x" и "abc" - ошибка, а не 0 или усечённое значение
+template <typename T>
+bool parseToken(const std::string& token, T& value)
+{
+    std::istringstream in(token);
+    T parsed;
+    if (!(in >> parsed) || !in.eof()) return false;
+    value = parsed;
+    return true;
+}
+
+inline bool readProblemList(const std::string& filename, double eps, int iterations, std::vector<BatchProblem>& problems)
+{
+    std::ifstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "Unable to open file " << filename << " for reading." << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        BatchProblem problem{ int(problems.size()), 0, {}, eps, iterations };
+        if (!(in >> problem.size)) continue;
+
+        if (!(in >> problem.corners[0] >> problem.corners[1] >> problem.corners[2] >> problem.corners[3]) || problem.size < 3)
+        {
+            std::cerr << filename << ':' << lineNumber << ": expected size and four corner values" << std::endl;
+            return false;
+        }
+
+        // Необязательные eps и iterations; после них ничего быть не должно
+        std::string token;
+        bool ok = true;
+        if (in >> token) ok = parseToken(token, problem.eps);
+        if (ok && in >> token) ok = parseToken(token, problem.iterations);
+        if (ok && in >> token) ok = false;
+        if (!ok || !(problem.eps > 0) || problem.iterations <= 0)
+        {
+            std::cerr << filename << ':' << lineNumber << ": expected positive eps and iterations after the corners" << std::endl;
+            return false;
+        }
+        problems.push_back(problem);
+    }
+    return true;
+}
+
+// Пул пар буферов по размеру сетки; в работе одновременно не больше пары на поток
+class GridPool {
+public:
+    struct Grids
+    {
+        int size;
+        AlignedBuffer<double> F;
+        AlignedBuffer<double> Fnew;
+    };
+
+    std::unique_ptr<Grids> acquire(int size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& list = free_[size];
+            if (!list.empty())
+            {
+                std::unique_ptr<Grids> grids = std::move(list.back());
+                list.pop_back();
+                return grids;
+            }
+            allocated_++;
+        }
+        // Первое касание - в потоке, который будет решать задачу
+        size_t len = (size_t)size * size;
+        return std::unique_ptr<Grids>(new Grids{ size, AlignedBuffer<double>(len), AlignedBuffer<double>(len) });
+    }
+
+    void release(std::unique_ptr<Grids> grids)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_[grids->size].push_back(std::move(grids));
+    }
+
+    int allocated() const { return allocated_; }
+
+private:
+    std::mutex mutex_;
+    std::map<int, std::vector<std::unique_ptr<Grids>>> free_;
+    int allocated_ = 0;
+};
+
+// Шаг Якоби одной сетки в одном потоке; при WithError - максимум изменения в том же проходе
+template <bool WithError>
+double batchSweep(double* __restrict Fnew, const double* __restrict F, int size)
+{
+    double error = 0.0;
+    for (int x = 1; x < size - 1; x++)
+    {
+        const long long row = (long long)x * size;
+        #pragma omp simd reduction(max:error)
+        for (int y = 1; y < size - 1; y++)
+        {
+            const long long c = row + y;
+            double value = 0.25 * (F[c + size] + F[c - size] + F[c - 1] + F[c + 1]);
+            Fnew[c] = value;
+            if constexpr (WithError) error = std::max(error, std::fabs(value - F[c]));
+        }
+    }
+    return error;
+}
+
+// Решает задачу в буферах grids; результат - в grids.F
+inline BatchResult solveBatchProblem(const BatchProblem& problem, GridPool::Grids& grids, int firstCheck, int minCheckInterval)
+{
+    const int size = problem.size;
+    const size_t len = (size_t)size * size;
+    double* F = grids.F.get();
+    double* Fnew = grids.Fnew.get();
+
+    double start = omp_get_wtime();
+
+    std::memset(F, 0, sizeof(double) * len);
+    initCornerBoundary(F, size, problem.corners[0], problem.corners[1], problem.corners[2], problem.corners[3]);
+    std::memcpy(Fnew, F, sizeof(double) * len);
+
+    ConvergenceMonitor monitor(problem.eps, firstCheck, minCheckInterval);
+    double error = 1;
+    int iteration = 0;
+    int nextCheck = monitor.interval();
+    do
+    {
+        iteration++;
+        if (iteration >= nextCheck || iteration >= problem.iterations)
+        {
+            error = batchSweep<true>(Fnew, F, size);
+            monitor.record(iteration, error);
+            nextCheck = iteration + monitor.interval();
+        }
+        else
+        {
+            batchSweep<false>(Fnew, F, size);
+        }
+        std::swap(F, Fnew);
+    } while (iteration < problem.iterations && error > problem.eps);
+
+    // Последний результат должен оказаться в grids.F
+    if (F != grids.F.get()) std::memcpy(grids.F.get(), F, sizeof(double) * len);
+
+    return { iteration, error, omp_get_wtime() - start };
+}
+
+// Решает все задачи; строки "id size iterations error seconds" пишутся в output
+// в порядке завершения. write(grid, size, id) вызывается для каждой решённой сетки, если задан.
+template <class WriteFn>
+int runBatch(std::vector<BatchProblem>& problems, const std::string& outputFile,
+             int firstCheck, int minCheckInterval, WriteFn&& write)
+{
+    std::ofstream output(outputFile);
+    if (!output.is_open())
+    {
+        std::cerr << "Unable to open file " << outputFile << " for writing." << std::endl;
+        return 1;
+    }
+    output << "# id size iterations error seconds\n";
+
+    // Сначала большие задачи, чтобы под конец потоки добирали мелкие
+    std::vector<int> order(problems.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return problems[a].size > problems[b].size; });
+
+    GridPool pool;
+    std::mutex outputMutex;
+    long long totalIterations = 0;
+    double updates = 0;
+
+    double start = omp_get_wtime();
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:totalIterations, updates)
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        PROFILE_RANGE("problem");
+        const BatchProblem& problem = problems[order[k]];
+        std::unique_ptr<GridPool::Grids> grids = pool.acquire(problem.size);
+
+        BatchResult result = solveBatchProblem(problem, *grids, firstCheck, minCheckInterval);
+        totalIterations += result.iterations;
+        updates += double(problem.size - 2) * (problem.size - 2) * result.iterations;
+
+        write(grids->F.get(), problem.size, problem.id);
+        {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            output << problem.id << ' ' << problem.size << ' ' << result.iterations << ' '
+                   << result.error << ' ' << result.seconds << '\n';
+        }
+        pool.release(std::move(grids));
+    }
+
+    double seconds = omp_get_wtime() - start;
+
+    std::cout << "Problems: " << problems.size() << std::endl;
+    std::cout << "Threads: " << omp_get_max_threads() << std::endl;
+    std::cout << "Time: " << seconds << " s" << std::endl;
+    std::cout << "Problems/s: " << problems.size() / seconds << std::endl;
+    std::cout << "Iterations: " << totalIterations << std::endl;
+    std::cout << "MLUPS: " << updates / seconds / 1e6 << std::endl;
+    std::cout << "Grid buffers: " << pool.allocated() << " pairs" << std::endl;
+    std::cout << "Results: " << outputFile << std::endl;
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include "../Common/grid_io.hpp"
+
+namespace po = boost::program_options;
+
+// Просмотр файлов .grd: заголовок и, при --output, перевод в текст формата saveMatrix
+int main(int argc, char *argv[])
+{
+    po::options_description desc("options");
+    desc.add_options()
+        ("input", po::value<std::string>(),"Grid file (.grd)")
+        ("output", po::value<std::string>()->default_value(""),"Write the grid as text matrix")
+        ("help", "Show all all command")
+    ;
+    po::positional_options_description positional;
+    positional.add("input", 1).add("output", 1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || !vm.count("input")) {
+        std::cout << "gridcat file.grd [out.txt]\n" << desc << "\n";
+        return 1;
+    }
+
+    std::string input = vm["input"].as<std::string>();
+    std::string output = vm["output"].as<std::string>();
+
+    std::vector<double> data;
+    GridHeader header;
+    double start = omp_get_wtime();
+    if (!loadGrid(input, data, header)) return 1;
+    double end = omp_get_wtime();
+
+    std::cout << "Grid: " << header.rows << 'x' << header.cols << std::endl;
+    std::cout << "\tBlocks: " << header.blockCount << " x " << header.blockRows << " rows" << std::endl;
+    std::cout << "\tCodec: " << ((header.codec & GRID_QUANTIZED) ? "quantized" : "raw")
+              << ((header.codec & GRID_ZSTD) ? " + zstd" : "") << std::endl;
+    if (header.codec & GRID_QUANTIZED) std::cout << "\tError bound: " << header.errorBound << std::endl;
+    std::cout << "The time: " << end - start << std::endl;
+
+    if (!output.empty())
+    {
+        std::ofstream outputFile(output);
+        if (!outputFile.is_open())
+        {
+            std::cerr << "Unable to open file " << output << " for writing." << std::endl;
+            return 1;
+        }
+
+        for (uint32_t i = 0; i < header.rows; ++i)
+        {
+            for (uint32_t j = 0; j < header.cols; ++j)
+            {
+                outputFile << std::setw(4) << std::fixed << std::setprecision(4) << data[(size_t)i * header.cols + j] << ' ';
+            }
+            outputFile << std::endl;
+        }
+    }
+
+    return 0;
+}
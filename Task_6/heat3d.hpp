@@ -0,0 +1,175 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <omp.h>
+
+#include "../Common/aligned_buffer.hpp"
+#include "../Common/convergence_monitor.hpp"
+#include "../Common/profile.hpp"
+#include "../Common/perf_counters.hpp"
+#include "../Common/tuning.hpp"
+
+// Трёхмерная задача на кубе size^3, 7-точечный шаблон Якоби.
+// Потоки OpenMP получают подряд идущие z-слои (слябы). Внутри сляба сетка
+// обходится плитками по y, а по z - потоком (2.5D-блокирование): три плоскости
+// плитки остаются в кэше, пока по ним проходит z. Внутренний цикл по x -
+// единичный шаг, векторизуется через omp simd.
+
+#define at3(arr, z, y, x) (arr[((long long)(z) * size + (y)) * size + (x)])
+
+// Грани - трилинейная интерполяция значений в восьми вершинах куба
+inline void initArrays3D(double* mainArr, double* subArr, int size, const double corners[8])
+{
+    PROFILE_RANGE("init");
+    double step = 1.0 / (size - 1);
+
+    #pragma omp parallel for schedule(static)
+    for (int z = 0; z < size; z++)
+    {
+        for (int y = 0; y < size; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                bool edge = z == 0 || y == 0 || x == 0 || z == size - 1 || y == size - 1 || x == size - 1;
+                double value = 0.0;
+                if (edge)
+                {
+                    double tz = z * step, ty = y * step, tx = x * step;
+                    for (int c = 0; c < 8; c++)
+                    {
+                        value += corners[c] * ((c & 4) ? tz : 1 - tz) * ((c & 2) ? ty : 1 - ty) * ((c & 1) ? tx : 1 - tx);
+                    }
+                }
+                at3(mainArr, z, y, x) = value;
+                at3(subArr, z, y, x) = value;
+            }
+        }
+    }
+}
+
+// Один шаг Якоби; при WithError в том же проходе считается максимум изменения
+template <bool WithError>
+double jacobiSweep3D(double* __restrict Fnew, const double* __restrict F, int size, int tileY)
+{
+    const long long plane = (long long)size * size;
+    double error = 0.0;
+
+    #pragma omp parallel reduction(max:error)
+    {
+        int thread = omp_get_thread_num();
+        int threads = omp_get_num_threads();
+        int inner = size - 2;
+        int zBegin = 1 + inner * thread / threads;
+        int zEnd = 1 + inner * (thread + 1) / threads;
+
+        for (int yy = 1; yy < size - 1; yy += tileY)
+        {
+            int yEnd = std::min(yy + tileY, size - 1);
+            for (int z = zBegin; z < zEnd; z++)
+            {
+                for (int y = yy; y < yEnd; y++)
+                {
+                    const long long row = (long long)z * plane + (long long)y * size;
+                    #pragma omp simd reduction(max:error)
+                    for (int x = 1; x < size - 1; x++)
+                    {
+                        const long long c = row + x;
+                        double value = (F[c - 1] + F[c + 1] + F[c - size] + F[c + size] + F[c - plane] + F[c + plane]) * (1.0 / 6.0);
+                        Fnew[c] = value;
+                        if constexpr (WithError) error = std::max(error, std::fabs(value - F[c]));
+                    }
+                }
+            }
+        }
+    }
+
+    return error;
+}
+
+struct Result3D
+{
+    int iterations;
+    double error;
+    double seconds;
+    size_t checks;
+};
+
+inline Result3D solve3D(int size, double eps, int iterations, int tileY, const double corners[8],
+                        int firstCheck, int minCheckInterval, const std::string& historyFile)
+{
+    const size_t len = (size_t)size * size * size;
+
+    // Первое касание со static-разбиением по потокам совпадает с разбиением на z-слябы
+    AlignedBuffer<double> ArrF(len);
+    AlignedBuffer<double> ArrFnew(len);
+    ArrF.firstTouch(omp_get_max_threads());
+    ArrFnew.firstTouch(omp_get_max_threads());
+    initArrays3D(ArrF.get(), ArrFnew.get(), size, corners);
+
+    double* F = ArrF.get();
+    double* Fnew = ArrFnew.get();
+
+    ConvergenceMonitor monitor(eps, firstCheck, minCheckInterval);
+
+    double start = omp_get_wtime();
+
+    double error = 1;
+    int iteration = 0;
+    int nextCheck = monitor.interval();
+    // Модель для счётчиков: 6 сложений и умножение на точку, F читается и Fnew пишется по разу
+    const double points = double(size - 2) * (size - 2) * (size - 2);
+    const double bytes = 2.0 * sizeof(double) * points;
+    do
+    {
+        iteration++;
+        if (iteration >= nextCheck || iteration >= iterations)
+        {
+            PROFILE_RANGE("sweep+residual");
+            PERF_KERNEL("sweep+residual", bytes, 9.0 * points);
+            error = jacobiSweep3D<true>(Fnew, F, size, tileY);
+            PROFILE_COUNTER("error", error);
+            monitor.record(iteration, error);
+            nextCheck = iteration + monitor.interval();
+        }
+        else
+        {
+            PROFILE_RANGE("sweep");
+            PERF_KERNEL("sweep", bytes, 6.0 * points);
+            jacobiSweep3D<false>(Fnew, F, size, tileY);
+        }
+        std::swap(F, Fnew);
+    } while (iteration < iterations && error > eps);
+
+    double end = omp_get_wtime();
+
+    if (!historyFile.empty()) monitor.save(historyFile);
+
+    return { iteration, error, end - start, monitor.checks() };
+}
+
+// Пробные прогоны по высоте плитки и числу потоков: фиксированное число итераций
+// без остановки по точности, время - из solve3D. Куб уменьшен до ~TUNE_TRIAL_WORK
+// точек за итерацию: полный size^3 выделялся бы и заполнялся заново в каждой пробе
+inline std::pair<TuneParams, double> tune3D(int fullSize, const double corners[8], int trialIterations)
+{
+    const int size = trialSize(fullSize, 3);
+    std::cout << "Trial size: " << size << std::endl;
+
+    std::vector<std::string> tiles;
+    for (int tile = 4; tile < size; tile *= 2)
+    {
+        tiles.push_back(std::to_string(tile));
+    }
+    tiles.push_back(std::to_string(size));
+
+    int threads = omp_get_max_threads();
+    auto candidates = tuneGrid({ { "tile", tiles }, { "threads", threadCandidates() } });
+    auto best = autotune(candidates, [&](TuneParams p) {
+        omp_set_num_threads(std::stoi(p["threads"]));
+        return solve3D(size, 0.0, trialIterations, std::stoi(p["tile"]), corners, trialIterations, trialIterations, "").seconds;
+    });
+    omp_set_num_threads(threads);
+    return best;
+}
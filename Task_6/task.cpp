@@ -4,14 +4,23 @@
 #include <cstring>
 #include <sstream>
 #include <memory>
+#include <atomic>
 #include <math.h>
 #include <cmath>
 #include <boost/program_options.hpp>
 
-#ifdef NVPROF_
-#include </opt/nvidia/hpc_sdk/Linux_x86_64/23.11/cuda/12.3/include/nvtx3/nvToolsExt.h>
-#endif
 #include <omp.h>
+
+#include "../Common/aligned_buffer.hpp"
+#include "../Common/convergence_monitor.hpp"
+#include "../Common/stencil.hpp"
+#include "../Common/grid_io.hpp"
+#include "../Common/profile.hpp"
+#include "../Common/perf_counters.hpp"
+#include "heat3d.hpp"
+#include "transient.hpp"
+#include "batch.hpp"
+
 namespace po = boost::program_options;
 
 #define at(arr, x, y) (arr[(x) * size + (y)])
@@ -21,10 +30,13 @@ constexpr int LEFT_UP = 10;
 constexpr int LEFT_DOWN = 20;
 constexpr int RIGHT_UP = 20;
 constexpr int RIGHT_DOWN = 30;
-constexpr int ITERS_BETWEEN_UPDATE = 70;
+constexpr int FIRST_CHECK = 70;
+constexpr int MIN_CHECK_INTERVAL = 10;
+constexpr int TUNE_ITERATIONS = 20;
 
-void initArrays(double* mainArr, double* subArr, int &size, bool& initMean)
+bool initArrays(double* mainArr, double* subArr, int &size, bool& initMean, const StencilConfig& stencil)
 {
+    PROFILE_RANGE("init");
     std::memset(mainArr, 0, sizeof(double) * size_sq);
 
     // Заполнение матрицы средними значениями
@@ -33,24 +45,20 @@ void initArrays(double* mainArr, double* subArr, int &size, bool& initMean)
         mainArr[i] = (LEFT_UP + LEFT_DOWN + RIGHT_UP + RIGHT_DOWN) / 4;
     }
 
-    at(mainArr, 0, 0) = LEFT_UP;
-    at(mainArr, 0, size - 1) = RIGHT_UP;
-    at(mainArr, size - 1, 0) = LEFT_DOWN;
-    at(mainArr, size - 1, size - 1) = RIGHT_DOWN;
-
-    for (int i = 1; i < size - 1; i++)
+    if (!stencil.boundaryFile.empty())
     {
-        at(mainArr, 0, i) = (at(mainArr, 0, size - 1) - at(mainArr, 0, 0)) / (size - 1) * i + at(mainArr, 0, 0);
-        at(mainArr, i, 0) = (at(mainArr, size - 1, 0) - at(mainArr, 0, 0)) / (size - 1) * i + at(mainArr, 0, 0);
-
-        at(mainArr, size - 1, i) = (at(mainArr, size - 1, size - 1) - at(mainArr, size - 1, 0)) / (size - 1) * i + at(mainArr, size - 1, 0);
-        at(mainArr, i, size - 1) = (at(mainArr, size - 1, size - 1) - at(mainArr, 0, size - 1)) / (size - 1) * i + at(mainArr, 0, size - 1);
+        if (!loadBoundary(stencil.boundaryFile, mainArr, size)) return false;
+    }
+    else
+    {
+        initCornerBoundary(mainArr, size, LEFT_UP, RIGHT_UP, LEFT_DOWN, RIGHT_DOWN);
     }
 
     std::memcpy(subArr, mainArr, sizeof(double) * size_sq);
+    return true;
 }
 
-void saveMatrix(double* mainArr, int size, const std::string& filename) 
+void saveMatrix(const double* mainArr, int size, const std::string& filename) 
 {
     std::ofstream outputFile(filename);
     if (!outputFile.is_open()) 
@@ -80,8 +88,24 @@ int main(int argc, char *argv[])
         ("iterations", po::value<int>()->default_value(1000000),"Max count of iteration")
         ("show", po::value<bool>()->default_value(false),"Show ResMatrix")
         ("init", po::value<bool>()->default_value(false),"Use mean value during init")
+        ("history", po::value<std::string>()->default_value(""),"Write error history to file")
+        ("format", po::value<std::string>()->default_value("text"),"Output format: text, grid or lossy")
+        ("error-bound", po::value<double>()->default_value(1e-4),"Max absolute error of the lossy format")
+        ("dims", po::value<int>()->default_value(2),"Dimension of the problem: 2 or 3")
+        ("tile", po::value<int>()->default_value(16),"Rows per cache tile in 3D mode")
+        ("scheme", po::value<std::string>()->default_value("steady"),"steady, explicit or implicit (time-dependent)")
+        ("alpha", po::value<double>()->default_value(1.0),"Thermal diffusivity for time-dependent schemes")
+        ("dt", po::value<double>()->default_value(0.0),"Time step (0 - from the stability limit)")
+        ("steps", po::value<int>()->default_value(1000),"Count of time steps")
+        ("snapshot-every", po::value<int>()->default_value(0),"Write a frame every N time steps (0 - never)")
+        ("snapshot-prefix", po::value<std::string>()->default_value("frame"),"Frame file name prefix")
+        ("snapshot-drop", po::value<bool>()->default_value(false),"Skip frames while the writer is busy instead of waiting")
+        ("batch", po::value<std::string>()->default_value(""),"Solve every problem from the list file (size and 4 corners per line)")
+        ("batch-output", po::value<std::string>()->default_value("batch_results.txt"),"Per-problem results of the batch mode")
         ("help", "Show all all command")
     ;
+    addStencilOptions(desc);
+    addTuningOptions(desc);
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -97,6 +121,134 @@ int main(int argc, char *argv[])
     int iterations = vm["iterations"].as<int>();
     bool showResult = vm["show"].as<bool>();
     bool initMean = vm["init"].as<bool>();
+    std::string historyFile = vm["history"].as<std::string>();
+
+    int dims = vm["dims"].as<int>();
+    if (dims != 2 && dims != 3)
+    {
+        std::cerr << "--dims must be 2 or 3" << std::endl;
+        return 1;
+    }
+    // 3D - стационарная задача с 7-точечным шаблоном и условиями Дирихле из углов, без вывода сетки
+    if (dims == 3)
+    {
+        for (const char* option : { "stencil", "boundary", "boundary-file", "coeff-file", "source",
+                                    "scheme", "init", "show", "format", "batch" })
+        {
+            if (!vm[option].defaulted())
+            {
+                std::cerr << "--" << option << " is not supported with --dims 3" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    bool binaryOutput;
+    GridOptions gridOptions;
+    if (!parseGridFormat(vm["format"].as<std::string>(), vm["error-bound"].as<double>(), binaryOutput, gridOptions)) return 1;
+
+    // Текст - прежний saveMatrix, иначе сжатый двоичный .grd.
+    // Кадры пишет поток SnapshotWriter, поэтому признак ошибки атомарный; при ошибке код возврата 1
+    std::atomic<bool> writeFailed(false);
+    auto writeGrid = [&](const double* grid, int n, const std::string& name) {
+        PROFILE_RANGE("io");
+        if (!binaryOutput) saveMatrix(grid, n, name);
+        else if (!saveGrid(grid, n, n, name, gridOptions)) writeFailed = true;
+    };
+    const std::string extension = binaryOutput ? ".grd" : ".txt";
+
+    StencilConfig stencil;
+    if (!readStencilConfig(vm, stencil)) return 1;
+
+    // Нестационарные схемы - 5-точечный шаблон с постоянной проводимостью, без источника
+    std::string scheme = vm["scheme"].as<std::string>();
+    if (scheme == "explicit" || scheme == "implicit")
+    {
+        if (stencil.stencil != Stencil::Five || stencil.hasSource() || !stencil.coeffFile.empty())
+        {
+            std::cerr << "--scheme " << scheme << " supports only --stencil 5 without --source and --coeff-file" << std::endl;
+            return 1;
+        }
+    }
+
+    std::string batchFile = vm["batch"].as<std::string>();
+    if (!batchFile.empty())
+    {
+        // Пакет решает только пластину с 5-точечным шаблоном и углами из файла списка
+        for (const char* option : { "stencil", "boundary", "boundary-file", "coeff-file", "source",
+                                    "scheme", "init" })
+        {
+            if (!vm[option].defaulted())
+            {
+                std::cerr << "--" << option << " is not supported with --batch" << std::endl;
+                return 1;
+            }
+        }
+
+        std::vector<BatchProblem> problems;
+        if (!readProblemList(batchFile, eps, iterations, problems)) return 1;
+
+        // С --show каждая решённая сетка сохраняется как batch_<id>
+        int status = runBatch(problems, vm["batch-output"].as<std::string>(), FIRST_CHECK, MIN_CHECK_INTERVAL,
+            [&](const double* grid, int n, int id) {
+                if (showResult) writeGrid(grid, n, "batch_" + std::to_string(id) + extension);
+            });
+        PROFILE_REPORT();
+        return writeFailed ? 1 : status;
+    }
+
+    if (dims == 3)
+    {
+        // Нижняя грань - как пластина в 2D, верхняя - она же, повёрнутая на 180 градусов
+        const double corners[8] = { LEFT_UP, RIGHT_UP, LEFT_DOWN, RIGHT_DOWN,
+                                    RIGHT_DOWN, LEFT_DOWN, RIGHT_UP, LEFT_UP };
+
+        // Плитка и потоки из файла настройки, если не заданы явно (--tile, OMP_NUM_THREADS)
+        int tile = vm["tile"].as<int>();
+        TuningCache cache("task6_3d", "size=" + std::to_string(size), vm["tuning-file"].as<std::string>());
+        TuneParams tuned;
+        if (vm["tune"].as<bool>())
+        {
+            auto [best, seconds] = tune3D(size, corners, TUNE_ITERATIONS);
+            if (cache.save(best, seconds)) std::cout << "Saved to " << cache.filename() << std::endl;
+            tuned = best;
+        }
+        else
+        {
+            cache.load(tuned);
+        }
+        if (vm["tile"].defaulted()) paramInt(tuned, "tile", tile);
+        int tunedThreads;
+        if (paramInt(tuned, "threads", tunedThreads) && tunedThreads > 0 && !std::getenv("OMP_NUM_THREADS"))
+        {
+            omp_set_num_threads(tunedThreads);
+        }
+        if (tile < 1)
+        {
+            std::cerr << "--tile must be at least 1" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Current settings:" << std::endl;
+        std::cout << "\tEPS: " << eps << std::endl;
+        std::cout << "\tMax iteration: " << iterations << std::endl;
+        std::cout << "\tSize: " << size << 'x' << size << 'x' << size << std::endl;
+        std::cout << "\tThreads: " << omp_get_max_threads() << std::endl;
+        std::cout << "\tTile: " << tile << std::endl;
+
+        Result3D result = solve3D(size, eps, iterations, tile, corners,
+                                  FIRST_CHECK, MIN_CHECK_INTERVAL, historyFile);
+
+        double updates = double(size - 2) * (size - 2) * (size - 2) * result.iterations;
+        std::cout << "Time: " << result.seconds << " s" << std::endl;
+        std::cout << "Iterations: " << result.iterations << std::endl;
+        std::cout << "Error: " << result.error << std::endl;
+        std::cout << "Error checks: " << result.checks << std::endl;
+        std::cout << "MLUPS: " << updates / result.seconds / 1e6 << std::endl;
+        PROFILE_REPORT();
+        PERF_REPORT();
+        return 0;
+    }
 
     std::cout << "Current settings:" << std::endl;
     std::cout << "\tEPS: " << eps << std::endl;
@@ -106,47 +258,94 @@ int main(int argc, char *argv[])
 
     double start = omp_get_wtime();
 
-    std::shared_ptr<double[]> ArrF(new double[size_sq]);
-    std::shared_ptr<double[]> ArrFnew(new double[size_sq]);
+    // Первое касание параллельно, чтобы страницы легли на узлы потоков multicore-версии
+    AlignedBuffer<double> ArrF(size_sq);
+    AlignedBuffer<double> ArrFnew(size_sq);
+    ArrF.firstTouch(omp_get_max_threads());
+    ArrFnew.firstTouch(omp_get_max_threads());
 
-    initArrays(ArrF.get(), ArrFnew.get(), size, initMean);
+    if (!initArrays(ArrF.get(), ArrFnew.get(), size, initMean, stencil)) return 1;
+
+    // Проводимость нужна только шаблону с переменными коэффициентами
+    int kLen = (stencil.stencil == Stencil::Variable) ? size_sq : 1;
+    AlignedBuffer<double> ArrK(kLen);
+    ArrK.firstTouch(omp_get_max_threads());
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < kLen; i++)
+    {
+        ArrK[i] = 1.0;
+    }
+    if (kLen > 1 && !stencil.coeffFile.empty() && !readMatrix(stencil.coeffFile, ArrK.get(), size)) return 1;
 
     double* F = ArrF.get();
     double* Fnew = ArrFnew.get();
+    double* K = ArrK.get();
 
-    double error = 0;
+    if (scheme == "explicit" || scheme == "implicit")
+    {
+        TransientConfig transient;
+        transient.implicit = scheme == "implicit";
+        transient.alpha = vm["alpha"].as<double>();
+        transient.dt = vm["dt"].as<double>();
+        transient.steps = vm["steps"].as<int>();
+        transient.snapshotEvery = vm["snapshot-every"].as<int>();
+        transient.snapshotPrefix = vm["snapshot-prefix"].as<std::string>();
+        transient.snapshotExtension = extension;
+        transient.snapshotDrop = vm["snapshot-drop"].as<bool>();
+
+        TransientResult result = solveTransient(F, Fnew, size, transient, stencil.boundary, eps, iterations, writeGrid);
+        if (result.r < 0) return 1;
+
+        double end = omp_get_wtime();
+        std::cout << "Time: " << end - start << " s" << std::endl;
+        std::cout << "Steps: " << transient.steps << ", dt = " << result.dt << ", r = " << result.r << std::endl;
+        if (transient.implicit) std::cout << "Inner iterations: " << result.innerIterations << std::endl;
+        std::cout << "Frames: " << result.framesWritten << " written, " << result.framesDropped << " dropped" << std::endl;
+        if (showResult) writeGrid(F, size, "matrix" + extension);
+        PROFILE_REPORT();
+        PERF_REPORT();
+        return writeFailed ? 1 : 0;
+    }
+    if (scheme != "steady")
+    {
+        std::cerr << "Unknown scheme: " << scheme << std::endl;
+        return 1;
+    }
+
+    ConvergenceMonitor monitor(eps, FIRST_CHECK, MIN_CHECK_INTERVAL);
+
+    double error = 1;
     int iteration = 0;
-    int itersBetweenUpdate = 0;
+    int nextCheck = monitor.interval();
 
-    #pragma acc data copyin(Fnew[:size_sq], F[:size_sq], error)
+    #pragma acc data copyin(Fnew[:size_sq], F[:size_sq], K[:kLen], error)
     {
-#ifdef NVPROF_
-        nvtxRangePush("MainCycle");
-#endif
+        PROFILE_RANGE("MainCycle");
         do
         {
-            #pragma acc parallel present(error) async
+            // Шаг Якоби: parallel loop collapse(2) по внутренним точкам в специализации
+            // под выбранный шаблон (present - данные уже на устройстве)
+            jacobiStep(stencil, Fnew, F, K, size, kLen);
+            
             {
-                error = 0;
+                PROFILE_RANGE("swap");
+                double *swap = F;
+                F = Fnew;
+                Fnew = swap;
             }
+            iteration++;
 
-            // Распараллеливаем вложенные циклы parallel loop collapse(2)
-            // (present - сообщают компилятору, что данные на устройстве)
-            #pragma acc parallel loop collapse(2) present(Fnew[:size_sq], F[:size_sq], error) async
-            for (int x = 1; x < size - 1; x++)
+            // Ошибка считается, когда подошла назначенная монитором итерация
+            // (и всегда на последней, чтобы напечатать актуальное значение)
+            if (iteration >= nextCheck || iteration >= iterations)
             {
-                for (int y = 1; y < size - 1; y++)
+                PROFILE_RANGE("residual");
+                PERF_KERNEL("residual", 2.0 * sizeof(double) * (size - 2) * (size - 2), 3.0 * (size - 2) * (size - 2));
+                #pragma acc parallel present(error) async
                 {
-                    at(Fnew, x, y) = 0.25 * (at(F, x + 1, y) + at(F, x - 1, y) + at(F, x, y - 1) + at(F, x, y + 1));
+                    error = 0;
                 }
-            }
-            
-            double *swap = F;
-            F = Fnew;
-            Fnew = swap;
 
-            if (itersBetweenUpdate >= ITERS_BETWEEN_UPDATE && iteration < iterations)
-            {
                 // Вычисление ошибки (Используем редукцию)
                 #pragma acc parallel loop collapse(2) present(Fnew[:size_sq], F[:size_sq], error) reduction(max:error) async
                 for (int x = 1; x < size - 1; x++)
@@ -157,29 +356,12 @@ int main(int argc, char *argv[])
                     }
                 }
                 #pragma acc update self(error) wait
-                itersBetweenUpdate = -1;
-            }
-            else
-            {
-                error = 1;
-            }
-            iteration++;
-            itersBetweenUpdate++;
-        } while (iteration < iterations && error > eps);
-#ifdef NVPROF_
-        nvtxRangePop();
-#endif
+                PROFILE_COUNTER("error", error);
 
-        // Последнее вычисление ошибки (Т.к был добавлен itersBetweenUpdate)
-        #pragma acc parallel loop collapse(2) present(Fnew[:size_sq], F[:size_sq], error) reduction(max:error) async
-        for (int x = 1; x < size - 1; x++)
-        {
-            for (int y = 1; y < size - 1; y++)
-            {
-                error = fmax(error, fabs(at(Fnew, x, y) - at(F, x, y)));
+                monitor.record(iteration, error);
+                nextCheck = iteration + monitor.interval();
             }
-        }
-        #pragma acc update self(error) wait
+        } while (iteration < iterations && error > eps);
     }
     #pragma acc data copyout(F[:size_sq], error)
 
@@ -188,9 +370,13 @@ int main(int argc, char *argv[])
     std::cout << "Time: " << end - start << " s" << std::endl;
     std::cout << "Iterations: " << iteration << std::endl;
     std::cout << "Error: " << error << std::endl;
-    if (showResult) saveMatrix(F, size, "matrix.txt");
+    std::cout << "Error checks: " << monitor.checks() << std::endl;
+    if (!historyFile.empty()) monitor.save(historyFile);
+    if (showResult) writeGrid(F, size, "matrix" + extension);
+    PROFILE_REPORT();
+    PERF_REPORT();
 
-    return 0;
+    return writeFailed ? 1 : 0;
 }
 
 
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <optional>
+#include <utility>
+
+#include "../Common/aligned_buffer.hpp"
+#include "../Common/convergence_monitor.hpp"
+#include "../Common/profile.hpp"
+#include "../Common/perf_counters.hpp"
+#include "../Common/snapshot_writer.hpp"
+#include "../Common/stencil.hpp"
+
+// Нестационарное уравнение теплопроводности u_t = alpha * laplace(u) на [0, 1]^2,
+// 5-точечный шаблон, r = alpha * dt / h^2.
+//   explicit - явный Эйлер, устойчив при r <= 1/4 (условие Куранта);
+//   implicit - неявный Эйлер: (1 + 4r) u - r * (соседи) = u_prev,
+//              система решается теми же итерациями Якоби с монитором сходимости.
+
+struct TransientConfig
+{
+    bool implicit = false;
+    double alpha = 1.0;
+    double dt = 0.0;            // 0 - выбрать по условию Куранта
+    int steps = 1000;
+    int snapshotEvery = 0;      // 0 - без кадров
+    std::string snapshotPrefix = "frame";
+    std::string snapshotExtension = ".txt";
+    bool snapshotDrop = false;  // пропускать кадры, если запись не успевает
+};
+
+struct TransientResult
+{
+    double dt;
+    double r;
+    long long innerIterations;
+    int framesWritten;
+    int framesDropped;
+};
+
+// Шаг явной схемы
+inline void explicitStep(double* Fnew, const double* F, int size, double r)
+{
+    long long len = (long long)size * size;
+
+    #pragma acc parallel loop collapse(2) present(Fnew[:len], F[:len]) async
+    for (int x = 1; x < size - 1; x++)
+    {
+        for (int y = 1; y < size - 1; y++)
+        {
+            const int c = x * size + y;
+            Fnew[c] = F[c] + r * (F[c + size] + F[c - size] + F[c - 1] + F[c + 1] - 4.0 * F[c]);
+        }
+    }
+}
+
+// Итерация Якоби для системы неявной схемы; Fold - решение на предыдущем шаге по времени
+inline void implicitSweep(double* Fnew, const double* F, const double* Fold, int size, double r)
+{
+    long long len = (long long)size * size;
+    const double scale = 1.0 / (1.0 + 4.0 * r);
+
+    #pragma acc parallel loop collapse(2) present(Fnew[:len], F[:len], Fold[:len]) async
+    for (int x = 1; x < size - 1; x++)
+    {
+        for (int y = 1; y < size - 1; y++)
+        {
+            const int c = x * size + y;
+            Fnew[c] = (Fold[c] + r * (F[c + size] + F[c - size] + F[c - 1] + F[c + 1])) * scale;
+        }
+    }
+}
+
+inline double maxDifference(const double* A, const double* B, int size)
+{
+    long long len = (long long)size * size;
+    double error = 0;
+
+    #pragma acc parallel loop collapse(2) present(A[:len], B[:len]) reduction(max:error)
+    for (int x = 1; x < size - 1; x++)
+    {
+        for (int y = 1; y < size - 1; y++)
+        {
+            error = fmax(error, fabs(A[x * size + y] - B[x * size + y]));
+        }
+    }
+    return error;
+}
+
+// F и Fnew - начальное состояние (одинаковое в обоих), на выходе результат в F.
+// eps и maxInner задают точность решения системы на каждом шаге неявной схемы.
+template <class WriteFn>
+TransientResult solveTransient(double*& F, double*& Fnew, int size, const TransientConfig& config,
+                               Boundary boundary, double eps, int maxInner, WriteFn&& write)
+{
+    const long long len = (long long)size * size;
+    const double h = 1.0 / (size - 1);
+    const double cflLimit = h * h / (4.0 * config.alpha);
+
+    TransientResult result{};
+    result.dt = config.dt > 0 ? config.dt : 0.9 * cflLimit;
+    result.r = config.alpha * result.dt / (h * h);
+
+    if (!config.implicit && result.dt > cflLimit)
+    {
+        std::cerr << "Time step " << result.dt << " violates the stability limit dt <= " << cflLimit
+                  << " of the explicit scheme; use a smaller --dt or --scheme implicit" << std::endl;
+        result.r = -1;
+        return result;
+    }
+
+    AlignedBuffer<double> ArrFold(config.implicit ? len : 1);
+    ArrFold.firstTouch(omp_get_max_threads());
+    double* Fold = ArrFold.get();
+    long long oldLen = config.implicit ? len : 1;
+
+    // Модель для счётчиков на шаг по внутренним точкам
+    const double points = double(size - 2) * (size - 2);
+
+    // Поток записи и его буферы кадров - только если кадры нужны
+    std::optional<SnapshotWriter> writer;
+    if (config.snapshotEvery > 0)
+    {
+        writer.emplace(size, len, config.snapshotPrefix, config.snapshotExtension, std::forward<WriteFn>(write),
+                       config.snapshotDrop);
+    }
+
+    // Указатели меняются местами, поэтому копируются оба буфера
+    #pragma acc data copy(F[:len], Fnew[:len]) copyin(Fold[:oldLen])
+    {
+        for (int step = 1; step <= config.steps; step++)
+        {
+            if (!config.implicit)
+            {
+                PROFILE_RANGE("sweep");
+                PERF_KERNEL("explicit", 2.0 * sizeof(double) * points, 7.0 * points);
+                explicitStep(Fnew, F, size, result.r);
+                applyBoundary(boundary, Fnew, size);
+                std::swap(F, Fnew);
+            }
+            else
+            {
+                #pragma acc parallel loop present(Fold[:len], F[:len]) async
+                for (long long c = 0; c < len; c++)
+                {
+                    Fold[c] = F[c];
+                }
+
+                // Начальное приближение - предыдущий шаг по времени
+                ConvergenceMonitor monitor(eps, 4, 1);
+                int nextCheck = monitor.interval();
+                double error = 1;
+                int inner = 0;
+                while (inner < maxInner && error > eps)
+                {
+                    {
+                        PROFILE_RANGE("sweep");
+                        PERF_KERNEL("implicit", 3.0 * sizeof(double) * points, 6.0 * points);
+                        implicitSweep(Fnew, F, Fold, size, result.r);
+                        applyBoundary(boundary, Fnew, size);
+                    }
+                    std::swap(F, Fnew);
+                    inner++;
+
+                    if (inner >= nextCheck)
+                    {
+                        PROFILE_RANGE("residual");
+                        #pragma acc wait
+                        error = maxDifference(F, Fnew, size);
+                        monitor.record(inner, error);
+                        nextCheck = inner + monitor.interval();
+                    }
+                }
+                result.innerIterations += inner;
+            }
+
+            if (writer && step % config.snapshotEvery == 0)
+            {
+                PROFILE_RANGE("snapshot");
+                #pragma acc update self(F[:len]) wait
+                writer->submit(F, step);
+            }
+        }
+        #pragma acc wait
+    }
+
+    if (writer)
+    {
+        writer->finish();
+        result.framesWritten = writer->written();
+        result.framesDropped = writer->dropped();
+    }
+    return result;
+}
@@ -11,10 +11,15 @@
 #ifdef CUBLAS
 #include "cublas_v2.h"
 #endif
-#ifdef NVPROF_
-#include </opt/nvidia/hpc_sdk/Linux_x86_64/23.11/cuda/12.3/include/nvtx3/nvToolsExt.h>
-#endif
 #include <omp.h>
+
+#include "../Common/aligned_buffer.hpp"
+#include "../Common/convergence_monitor.hpp"
+#include "../Common/grid_io.hpp"
+#include "../Common/profile.hpp"
+#include "../Common/perf_counters.hpp"
+#include "../Common/stencil.hpp"
+
 namespace po = boost::program_options;
 
 #define at(arr, x, y) (arr[(x) * size + (y)])
@@ -24,11 +29,13 @@ constexpr int LEFT_UP = 10;
 constexpr int LEFT_DOWN = 20;
 constexpr int RIGHT_UP = 20;
 constexpr int RIGHT_DOWN = 30;
-constexpr int ITERS_BETWEEN_UPDATE = 70;
+constexpr int FIRST_CHECK = 70;
+constexpr int MIN_CHECK_INTERVAL = 10;
 constexpr double negOne = -1;
 
-void initArrays(double* mainArr, double* subArr, int &size, bool& initMean)
+bool initArrays(double* mainArr, double* subArr, int &size, bool& initMean, const StencilConfig& stencil)
 {
+    PROFILE_RANGE("init");
     std::memset(mainArr, 0, sizeof(double) * size_sq);
 
     // Заполнение матрицы средними значениями
@@ -37,21 +44,17 @@ void initArrays(double* mainArr, double* subArr, int &size, bool& initMean)
         mainArr[i] = (LEFT_UP + LEFT_DOWN + RIGHT_UP + RIGHT_DOWN) / 4;
     }
 
-    at(mainArr, 0, 0) = LEFT_UP;
-    at(mainArr, 0, size - 1) = RIGHT_UP;
-    at(mainArr, size - 1, 0) = LEFT_DOWN;
-    at(mainArr, size - 1, size - 1) = RIGHT_DOWN;
-
-    for (int i = 1; i < size - 1; i++)
+    if (!stencil.boundaryFile.empty())
     {
-        at(mainArr, 0, i) = (at(mainArr, 0, size - 1) - at(mainArr, 0, 0)) / (size - 1) * i + at(mainArr, 0, 0);
-        at(mainArr, i, 0) = (at(mainArr, size - 1, 0) - at(mainArr, 0, 0)) / (size - 1) * i + at(mainArr, 0, 0);
-
-        at(mainArr, size - 1, i) = (at(mainArr, size - 1, size - 1) - at(mainArr, size - 1, 0)) / (size - 1) * i + at(mainArr, size - 1, 0);
-        at(mainArr, i, size - 1) = (at(mainArr, size - 1, size - 1) - at(mainArr, 0, size - 1)) / (size - 1) * i + at(mainArr, 0, size - 1);
+        if (!loadBoundary(stencil.boundaryFile, mainArr, size)) return false;
+    }
+    else
+    {
+        initCornerBoundary(mainArr, size, LEFT_UP, RIGHT_UP, LEFT_DOWN, RIGHT_DOWN);
     }
 
     std::memcpy(subArr, mainArr, sizeof(double) * size_sq);
+    return true;
 }
 
 void saveMatrix(double* mainArr, int size, const std::string& filename) 
@@ -84,8 +87,12 @@ int main(int argc, char *argv[])
         ("iterations", po::value<int>()->default_value(1000000),"Max count of iteration")
         ("show", po::value<bool>()->default_value(false),"Show ResMatrix")
         ("init", po::value<bool>()->default_value(false),"Use mean value during init")
+        ("history", po::value<std::string>()->default_value(""),"Write error history to file")
+        ("format", po::value<std::string>()->default_value("text"),"Output format: text, grid or lossy")
+        ("error-bound", po::value<double>()->default_value(1e-4),"Max absolute error of the lossy format")
         ("help", "Show all all command")
     ;
+    addStencilOptions(desc);
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -101,6 +108,14 @@ int main(int argc, char *argv[])
     int iterations = vm["iterations"].as<int>();
     bool showResult = vm["show"].as<bool>();
     bool initMean = vm["init"].as<bool>();
+    std::string historyFile = vm["history"].as<std::string>();
+
+    bool binaryOutput;
+    GridOptions gridOptions;
+    if (!parseGridFormat(vm["format"].as<std::string>(), vm["error-bound"].as<double>(), binaryOutput, gridOptions)) return 1;
+
+    StencilConfig stencil;
+    if (!readStencilConfig(vm, stencil)) return 1;
 
     std::cout << "Current settings:" << std::endl;
     std::cout << "\tEPS: " << eps << std::endl;
@@ -110,19 +125,37 @@ int main(int argc, char *argv[])
 
     double start = omp_get_wtime();
 
-    std::shared_ptr<double[]> ArrF(new double[size_sq]);
-    std::shared_ptr<double[]> ArrFnew(new double[size_sq]);
-    std::shared_ptr<double[]> Arrinter(new double[size_sq]);
-
-    initArrays(ArrF.get(), ArrFnew.get(), size, initMean);
+    // Первое касание параллельно, чтобы страницы легли на узлы потоков multicore-версии
+    AlignedBuffer<double> ArrF(size_sq);
+    AlignedBuffer<double> ArrFnew(size_sq);
+    AlignedBuffer<double> Arrinter(size_sq);
+    ArrF.firstTouch(omp_get_max_threads());
+    ArrFnew.firstTouch(omp_get_max_threads());
+    Arrinter.firstTouch(omp_get_max_threads());
+
+    if (!initArrays(ArrF.get(), ArrFnew.get(), size, initMean, stencil)) return 1;
+
+    // Проводимость нужна только шаблону с переменными коэффициентами
+    int kLen = (stencil.stencil == Stencil::Variable) ? size_sq : 1;
+    AlignedBuffer<double> ArrK(kLen);
+    ArrK.firstTouch(omp_get_max_threads());
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < kLen; i++)
+    {
+        ArrK[i] = 1.0;
+    }
+    if (kLen > 1 && !stencil.coeffFile.empty() && !readMatrix(stencil.coeffFile, ArrK.get(), size)) return 1;
 
     double* F = ArrF.get();
     double* Fnew = ArrFnew.get();
     double* inter = Arrinter.get();
+    double* K = ArrK.get();
+
+    ConvergenceMonitor monitor(eps, FIRST_CHECK, MIN_CHECK_INTERVAL);
 
     double error = 1;
     int iteration = 0;
-    int itersBetweenUpdate = 0;
+    int nextCheck = monitor.interval();
     int max_idx = 0;
 
     #ifdef CUBLAS
@@ -131,24 +164,22 @@ int main(int argc, char *argv[])
         cublasCreate(&handle);
     #endif
 
-    #pragma acc data copy(Fnew[:size_sq], F[:size_sq], inter[:size_sq])
+    #pragma acc data copy(Fnew[:size_sq], F[:size_sq], inter[:size_sq]) copyin(K[:kLen])
     do
     {
-        #pragma acc parallel loop collapse(2) present(Fnew[:size_sq], F[:size_sq]) async
-        for (int x = 1; x < size - 1; x++)
+        jacobiStep(stencil, Fnew, F, K, size, kLen);
+        
         {
-            for (int y = 1; y < size - 1; y++)
-            {
-                at(Fnew, x, y) = 0.25 * (at(F, x + 1, y) + at(F, x - 1, y) + at(F, x, y - 1) + at(F, x, y + 1));
-            }
+            PROFILE_RANGE("swap");
+            double *swap = F;
+            F = Fnew;
+            Fnew = swap;
         }
-        
-        double *swap = F;
-        F = Fnew;
-        Fnew = swap;
+        iteration++;
 
-        if (itersBetweenUpdate >= ITERS_BETWEEN_UPDATE && iteration < iterations)
+        if (iteration >= nextCheck || iteration >= iterations)
         {
+            PROFILE_RANGE("residual");
             #pragma acc data present(inter[:size_sq], Fnew[:size_sq], F[:size_sq]) wait
             {
                 #pragma acc host_data use_device(Fnew, F, inter)
@@ -167,10 +198,11 @@ int main(int argc, char *argv[])
             }
             #pragma acc update self(inter[max_idx-1]) wait
             error = fabs(inter[max_idx-1]);
-            itersBetweenUpdate = -1;
+            PROFILE_COUNTER("error", error);
+
+            monitor.record(iteration, error);
+            nextCheck = iteration + monitor.interval();
         }
-        iteration++;
-        itersBetweenUpdate++;
     } while (iteration < iterations && error > eps);
 
 #ifdef CUBLAS
@@ -181,9 +213,19 @@ int main(int argc, char *argv[])
     std::cout << "Time: " << end - start << " s" << std::endl;
     std::cout << "Iterations: " << iteration << std::endl;
     std::cout << "Error: " << error << std::endl;
-    if (showResult) saveMatrix(ArrF.get(), size, "matrix.txt");
+    std::cout << "Error checks: " << monitor.checks() << std::endl;
+    if (!historyFile.empty()) monitor.save(historyFile);
+    bool saved = true;
+    if (showResult)
+    {
+        PROFILE_RANGE("io");
+        if (binaryOutput) saved = saveGrid(ArrF.get(), size, size, "matrix.grd", gridOptions);
+        else saveMatrix(ArrF.get(), size, "matrix.txt");
+    }
+    PROFILE_REPORT();
+    PERF_REPORT();
 
-    return 0;
+    return saved ? 0 : 1;
 }
 
 // cublasStatus_t cublasIdamax(cublasHandle_t handle, int n,
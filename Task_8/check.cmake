@@ -0,0 +1,28 @@
+# Проверка HOST-сборки: cmake -DTASK=<task> -DARGS="--size;64" -DITERATIONS=N -DEPS=e -P check.cmake
+# Решение детерминировано, поэтому число итераций сверяется точно, а ошибка - с EPS.
+# С ITERATIONS_MAX допустим диапазон [ITERATIONS, ITERATIONS_MAX]: в режиме --pipeline
+# к моменту, когда прочитана ошибка ниже EPS, уже посчитана следующая, спекулятивная пачка,
+# и итераций выходит больше, чем в обычном режиме, не более чем на одну пачку
+if(NOT DEFINED ITERATIONS_MAX)
+    set(ITERATIONS_MAX ${ITERATIONS})
+endif()
+
+execute_process(COMMAND ${TASK} ${ARGS} --eps ${EPS}
+                OUTPUT_VARIABLE output
+                RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${TASK} exited with ${status}:\n${output}")
+endif()
+
+string(REGEX MATCH "Iterations: ([0-9]+)" _ "${output}")
+set(iterations "${CMAKE_MATCH_1}")
+string(REGEX MATCH "Error: ([0-9.eE+-]+)" _ "${output}")
+set(error "${CMAKE_MATCH_1}")
+
+if(iterations STREQUAL "" OR iterations LESS ITERATIONS OR iterations GREATER ITERATIONS_MAX)
+    message(FATAL_ERROR "Expected ${ITERATIONS}..${ITERATIONS_MAX} iterations, got '${iterations}':\n${output}")
+endif()
+if(error STREQUAL "" OR error GREATER EPS)
+    message(FATAL_ERROR "Expected error <= ${EPS}, got '${error}':\n${output}")
+endif()
+message(STATUS "Iterations: ${iterations}, error: ${error}")
@@ -0,0 +1,167 @@
+#pragma once
+
+// Замена используемой части CUDA Runtime для сборки без GPU (BACKEND=HOST).
+// "Память устройства" - обычная память хоста, поток - очередь работ:
+// во время захвата работы складываются в граф, иначе выполняются сразу,
+// поэтому cudaStreamSynchronize ничего не ждёт.
+
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#define __global__
+#define __device__
+#define __host__
+#define __shared__
+
+struct dim3 {
+    unsigned int x, y, z;
+    dim3(unsigned int vx = 1, unsigned int vy = 1, unsigned int vz = 1) : x(vx), y(vy), z(vz) {}
+};
+
+using cudaError_t = int;
+constexpr cudaError_t cudaSuccess = 0;
+constexpr cudaError_t cudaErrorMemoryAllocation = 2;
+constexpr cudaError_t cudaErrorNotReady = 600;
+
+inline const char* cudaGetErrorString(cudaError_t err) {
+    if (err == cudaSuccess) return "no error";
+    if (err == cudaErrorNotReady) return "device not ready";
+    return "out of memory";
+}
+
+enum cudaMemcpyKind {
+    cudaMemcpyHostToHost,
+    cudaMemcpyHostToDevice,
+    cudaMemcpyDeviceToHost,
+    cudaMemcpyDeviceToDevice
+};
+
+inline cudaError_t cudaMalloc(void** ptr, size_t bytes) {
+    *ptr = std::malloc(bytes);
+    return *ptr ? cudaSuccess : cudaErrorMemoryAllocation;
+}
+
+inline cudaError_t cudaFree(void* ptr) {
+    std::free(ptr);
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaMemcpy(void* dst, const void* src, size_t bytes, cudaMemcpyKind) {
+    std::memcpy(dst, src, bytes);
+    return cudaSuccess;
+}
+
+// Закреплённая память на хосте ничем не отличается от обычной
+inline cudaError_t cudaMallocHost(void** ptr, size_t bytes) {
+    return cudaMalloc(ptr, bytes);
+}
+
+inline cudaError_t cudaFreeHost(void* ptr) {
+    return cudaFree(ptr);
+}
+
+struct HostGraph {
+    std::vector<std::function<void()>> nodes;
+};
+
+struct HostStream {
+    HostGraph* capture = nullptr;
+
+    void enqueue(std::function<void()> work) {
+        if (capture) capture->nodes.push_back(std::move(work));
+        else work();
+    }
+};
+
+using cudaStream_t = HostStream*;
+using cudaGraph_t = HostGraph*;
+using cudaGraphExec_t = HostGraph*;
+
+enum cudaStreamCaptureMode {
+    cudaStreamCaptureModeGlobal,
+    cudaStreamCaptureModeThreadLocal,
+    cudaStreamCaptureModeRelaxed
+};
+
+inline cudaError_t cudaStreamCreate(cudaStream_t* stream) {
+    *stream = new HostStream;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaStreamDestroy(cudaStream_t stream) {
+    delete stream;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaStreamSynchronize(cudaStream_t) {
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaMemcpyAsync(void* dst, const void* src, size_t bytes, cudaMemcpyKind, cudaStream_t stream) {
+    stream->enqueue([=]() { std::memcpy(dst, src, bytes); });
+    return cudaSuccess;
+}
+
+// Событие становится готовым, когда поток доходит до места его записи
+struct HostEvent {
+    bool ready = true;
+};
+
+using cudaEvent_t = HostEvent*;
+constexpr unsigned int cudaEventDisableTiming = 2;
+
+inline cudaError_t cudaEventCreateWithFlags(cudaEvent_t* event, unsigned int) {
+    *event = new HostEvent;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaEventDestroy(cudaEvent_t event) {
+    delete event;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaEventRecord(cudaEvent_t event, cudaStream_t stream) {
+    event->ready = false;
+    stream->enqueue([=]() { event->ready = true; });
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaEventQuery(cudaEvent_t event) {
+    return event->ready ? cudaSuccess : cudaErrorNotReady;
+}
+
+inline cudaError_t cudaStreamBeginCapture(cudaStream_t stream, cudaStreamCaptureMode) {
+    stream->capture = new HostGraph;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaStreamEndCapture(cudaStream_t stream, cudaGraph_t* graph) {
+    *graph = stream->capture;
+    stream->capture = nullptr;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaGraphInstantiate(cudaGraphExec_t* exec, cudaGraph_t graph,
+                                        void* = nullptr, char* = nullptr, size_t = 0) {
+    *exec = new HostGraph(*graph);
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaGraphLaunch(cudaGraphExec_t exec, cudaStream_t stream) {
+    for (const auto& node : exec->nodes) {
+        stream->enqueue(node);
+    }
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaGraphDestroy(cudaGraph_t graph) {
+    delete graph;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaGraphExecDestroy(cudaGraphExec_t exec) {
+    delete exec;
+    return cudaSuccess;
+}
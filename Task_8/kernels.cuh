@@ -0,0 +1,133 @@
+#pragma once
+
+// Ядра решателя и слой их запуска.
+// Вычисления для одной точки сетки общие; в CUDA-сборке они вызываются из __global__ ядер,
+// в HOST-сборке - из циклов OpenMP по той же сетке блоков и потоков.
+// Запуск оформлен макросом LAUNCH, который в HOST-сборке кладёт работу в поток
+// (и, значит, может быть захвачен в граф так же, как запуск <<<>>>).
+
+#include <cmath>
+#include <algorithm>
+
+#ifdef HOST_BACKEND
+#include "host_runtime.hpp"
+#else
+#include <cuda_runtime.h>
+#include <cub/cub.cuh>
+#endif
+
+__host__ __device__ inline bool isInner(int i, int j, int size) {
+    return i > 0 && j > 0 && i < size - 1 && j < size - 1;
+}
+
+__host__ __device__ inline void iterateCell(double* matrix, const double* lastMatrix, int size, int i, int j) {
+    matrix[i * size + j] = 0.25 * (lastMatrix[i * size + j + 1] + lastMatrix[i * size + j - 1] +
+                                   lastMatrix[(i - 1) * size + j] + lastMatrix[(i + 1) * size + j]);
+}
+
+__host__ __device__ inline double errorCell(const double* matrix, const double* lastMatrix, int size, int i, int j) {
+    return fabs(matrix[i * size + j] - lastMatrix[i * size + j]);
+}
+
+#ifndef HOST_BACKEND
+
+#define LAUNCH(kernel, grid, block, stream, ...) kernel<<<grid, block, 0, stream>>>(__VA_ARGS__)
+
+__global__ void iterate(double* matrix, double* lastMatrix, int size) {
+    int j = blockIdx.x * blockDim.x + threadIdx.x;
+    int i = blockIdx.y * blockDim.y + threadIdx.y;
+
+    // Exclude values on the edges
+    if (!isInner(i, j, size)) return;
+
+    iterateCell(matrix, lastMatrix, size, i, j);
+}
+
+// Блок blockSize x blockSize потоков; все потоки блока должны дойти до Reduce
+template <unsigned int blockSize>
+__global__ void compute_error(double* matrix, double* lastMatrix, double* errors, int size) {
+    int j = blockIdx.x * blockDim.x + threadIdx.x;
+    int i = blockIdx.y * blockDim.y + threadIdx.y;
+
+    using BlockReduce = cub::BlockReduce<double, blockSize, cub::BLOCK_REDUCE_WARP_REDUCTIONS, blockSize>;
+
+    // Allocate the temporary storage for a block of blockSize x blockSize threads of type double
+    __shared__ typename BlockReduce::TempStorage temp_storage;
+    double local_max = 0.0;
+
+    if (isInner(i, j, size)) {
+        local_max = errorCell(matrix, lastMatrix, size, i, j);
+    }
+
+    // Calculate the largest value in the block using the reduction operation
+    double block_max = BlockReduce(temp_storage).Reduce(local_max, cub::Max());
+
+    if (threadIdx.x == 0 && threadIdx.y == 0) {
+        errors[blockIdx.y * gridDim.x + blockIdx.x] = block_max;
+    }
+}
+
+// Сводит максимумы блоков к одному числу на устройстве; запускается одним блоком
+template <unsigned int blockSize>
+__global__ void reduce_max(const double* errors, int count, double* result) {
+    using BlockReduce = cub::BlockReduce<double, blockSize>;
+    __shared__ typename BlockReduce::TempStorage temp_storage;
+
+    double local_max = 0.0;
+    for (int k = threadIdx.x; k < count; k += blockSize) {
+        local_max = fmax(local_max, errors[k]);
+    }
+
+    double block_max = BlockReduce(temp_storage).Reduce(local_max, cub::Max());
+
+    if (threadIdx.x == 0) {
+        *result = block_max;
+    }
+}
+
+#else
+
+#define LAUNCH(kernel, grid, block, stream, ...) (stream)->enqueue([=]() { kernel(grid, block, __VA_ARGS__); })
+
+// Блоки распределяются между потоками OpenMP, потоки блока выполняются последовательно
+inline void iterate(dim3 gridDim, dim3 blockDim, double* matrix, double* lastMatrix, int size) {
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (int by = 0; by < int(gridDim.y); by++) {
+        for (int bx = 0; bx < int(gridDim.x); bx++) {
+            for (int ty = 0; ty < int(blockDim.y); ty++) {
+                int i = by * blockDim.y + ty;
+                #pragma omp simd
+                for (int tx = 0; tx < int(blockDim.x); tx++) {
+                    int j = bx * blockDim.x + tx;
+                    if (isInner(i, j, size)) iterateCell(matrix, lastMatrix, size, i, j);
+                }
+            }
+        }
+    }
+}
+
+// Аналог cub::BlockReduce: максимум по потокам блока записывается в errors[номер блока]
+template <unsigned int blockSize>
+void compute_error(dim3 gridDim, dim3 blockDim, double* matrix, double* lastMatrix, double* errors, int size) {
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (int by = 0; by < int(gridDim.y); by++) {
+        for (int bx = 0; bx < int(gridDim.x); bx++) {
+            double block_max = 0.0;
+            for (int ty = 0; ty < int(blockDim.y); ty++) {
+                int i = by * blockDim.y + ty;
+                for (int tx = 0; tx < int(blockDim.x); tx++) {
+                    int j = bx * blockDim.x + tx;
+                    if (isInner(i, j, size)) block_max = std::max(block_max, errorCell(matrix, lastMatrix, size, i, j));
+                }
+            }
+            errors[by * gridDim.x + bx] = block_max;
+        }
+    }
+}
+
+template <unsigned int blockSize>
+void reduce_max(dim3, dim3, const double* errors, int count, double* result) {
+    *result = *std::max_element(errors, errors + count);
+}
+
+#endif
@@ -7,8 +7,14 @@
 #include <iomanip>
 #include <chrono>
 #include <vector>
-#include <cuda_runtime.h>
-#include <cub/cub.cuh>
+#include <thread>
+
+#include "kernels.cuh"
+#include "../Common/aligned_buffer.hpp"
+#include "../Common/convergence_monitor.hpp"
+#include "../Common/grid_io.hpp"
+#include "../Common/profile.hpp"
+#include "../Common/tuning.hpp"
 
 namespace po = boost::program_options;
 
@@ -19,6 +25,11 @@ constexpr int LEFT_UP = 10;
 constexpr int LEFT_DOWN = 20;
 constexpr int RIGHT_UP = 20;
 constexpr int RIGHT_DOWN = 30;
+constexpr int BLOCK = 32;
+constexpr int GRAPH_BATCH = 100;
+constexpr int TUNE_ITERATIONS = 2000;
+constexpr double TUNE_CELL_UPDATES = 2e9;
+constexpr int FIRST_CHECK = 1000;
 
 template <class ctype>
 class Data {
@@ -27,9 +38,9 @@ private:
     ctype* d_arr;
 
 public:
-    std::vector<ctype> arr;
+    aligned_vector<ctype> arr;
 
-    Data(int length) : len(length), arr(len), d_arr(nullptr) {
+    Data(int length) : len(length), d_arr(nullptr), arr(len, ctype()) {
         cudaError_t err = cudaMalloc((void**)&d_arr, len * sizeof(ctype));
         if (err != cudaSuccess) {
             std::cerr << "CUDA memory allocation failed: " << cudaGetErrorString(err) << std::endl;
@@ -65,7 +76,7 @@ public:
 };
 
 
-void initMatrix(std::vector<double>& mainArr, int size) {
+void initMatrix(aligned_vector<double>& mainArr, int size) {
     at(mainArr, 0, 0) = LEFT_UP;
     at(mainArr, 0, size - 1) = RIGHT_UP;
     at(mainArr, size - 1, 0) = LEFT_DOWN;
@@ -101,81 +112,35 @@ void saveMatrix(const double* mainArr, int size, const std::string& filename)
     outputFile.close();
 }
 
-__global__ void iterate(double* matrix, double* lastMatrix, int size) {
-    int j = blockIdx.x * blockDim.x + threadIdx.x;
-    int i = blockIdx.y * blockDim.y + threadIdx.y;
-
-    // Exclude values on the edges
-    if (j == 0 || i == 0 || i >= size - 1 || j >= size - 1) return;
-
-    at(matrix, i, j) = 0.25 * (at(lastMatrix, i, j + 1) + at(lastMatrix, i, j - 1) +
-                                at(lastMatrix, i - 1, j) + at(lastMatrix, i + 1, j));
-}
-
-template <unsigned int blockSize>
-__global__ void compute_error(double* matrix, double* lastMatrix, double* errors, int size) {
-    int j = blockIdx.x * blockDim.x + threadIdx.x;
-    int i = blockIdx.y * blockDim.y + threadIdx.y;
-
-    if (j >= size || i >= size) return;
-
-    // Allocate the temporary storage for a block of blockSize(32) threads of type double
-    __shared__ typename cub::BlockReduce<double, blockSize>::TempStorage temp_storage;
-    double local_max = 0.0;
-
-    if (j > 0 && i > 0 && j < size - 1 && i < size - 1) {
-        local_max = fabs(at(matrix, i, j) - at(lastMatrix, i, j));
-    }
+struct Settings {
+    int block;      // сторона блока потоков: 8, 16 или 32
+    int batch;      // итераций в одном графе, чётное
+    bool pipeline;
+};
 
-    // Calculate the largest value in the block using the reduction operation
-    double block_max = cub::BlockReduce<double, blockSize>(temp_storage).Reduce(local_max, cub::Max());
+struct Result {
+    int iterations;
+    double error;
+    size_t checks;
+};
 
-    if (threadIdx.x == 0 && threadIdx.y == 0) {
-        errors[blockIdx.y * gridDim.x + blockIdx.x] = block_max;
+// compute_error параметризован стороной блока на этапе компиляции
+void launchComputeError(dim3 gridDim, dim3 blockDim, cudaStream_t stream,
+                        double* matrix, double* lastMatrix, double* errors, int size) {
+    switch (blockDim.x) {
+    case 8: LAUNCH(compute_error<8>, gridDim, blockDim, stream, matrix, lastMatrix, errors, size); break;
+    case 16: LAUNCH(compute_error<16>, gridDim, blockDim, stream, matrix, lastMatrix, errors, size); break;
+    default: LAUNCH(compute_error<32>, gridDim, blockDim, stream, matrix, lastMatrix, errors, size); break;
     }
 }
 
-
-int main(int argc, char const *argv[]) {
-    po::options_description desc("options");
-    desc.add_options()
-        ("eps", po::value<double>()->default_value(1e-6),"Accuracy")
-        ("size", po::value<int>()->default_value(10),"Matrix size")
-        ("iterations", po::value<int>()->default_value(1000000),"Max count of iteration")
-        ("show", po::value<bool>()->default_value(false),"Show ResMatrix")
-        ("help", "Show all all command");
-
-    po::variables_map vm;
-    po::store(po::parse_command_line(argc, argv, desc), vm);
-    po::notify(vm);
-
-    if (vm.count("help")) {
-        std::cout << desc << "\n";
-        return 1;
-    }
-
-    double eps = vm["eps"].as<double>();
-    int size = vm["size"].as<int>();
-    int iterations = vm["iterations"].as<int>();
-    bool showResult = vm["show"].as<bool>();
-
-    std::cout << "Current settings:" << std::endl;
-    std::cout << "\tEPS: " << eps << std::endl;
-    std::cout << "\tMax iteration: " << iterations << std::endl;
-    std::cout << "\tSize: " << size << 'x' << size << std::endl;
-
+// Решает задачу из начального состояния A и Anew; результат остаётся в Anew.arr
+Result solve(Data<double>& A, Data<double>& Anew, int size, double eps, int iterations,
+             const Settings& settings, const std::string& historyFile) {
     double error = 1.0;
     int iter = 0;
 
-    Data<double> A(size_sq);
-    Data<double> Anew(size_sq);
-
-    initMatrix(A.arr, size);
-    initMatrix(Anew.arr, size);
-
-    auto start = std::chrono::high_resolution_clock::now();
-
-    dim3 blockDim(32, 32);
+    dim3 blockDim(settings.block, settings.block);
     dim3 gridDim((size + blockDim.x - 1) / blockDim.x, (size + blockDim.y - 1) / blockDim.y);
 
     int totalBlocks = gridDim.x * gridDim.y;
@@ -208,54 +173,237 @@ int main(int argc, char const *argv[]) {
     });
 
     cudaStreamCreate(stream.get());
-    bool graphCreated = false;
 
-    while (iter < iterations && error > eps) {
-        if (!graphCreated) 
-        {
-            // Start capturing the graph
-            cudaStreamBeginCapture(*stream, cudaStreamCaptureModeGlobal);
-
-            for (int i = 0; i < 999; i++) {
-                iterate<<<gridDim, blockDim, 0, *stream>>>(A_link, Anew_link, size);
-                std::swap(A_link, Anew_link);
+    // Граф содержит settings.batch итераций (чётное число, поэтому указатели
+    // возвращаются на место, а последний результат оказывается в Anew)
+    cudaStreamBeginCapture(*stream, cudaStreamCaptureModeGlobal);
+    for (int i = 0; i < settings.batch; i++) {
+        LAUNCH(iterate, gridDim, blockDim, *stream, A_link, Anew_link, size);
+        std::swap(A_link, Anew_link);
+    }
+    cudaStreamEndCapture(*stream, graph.get());
+    cudaGraphInstantiate(graphExec.get(), *graph, nullptr, nullptr, 0);
+
+    ConvergenceMonitor monitor(eps, FIRST_CHECK, settings.batch);
+
+    // Итерация, на которой монитор ждёт следующую проверку
+    int nextCheck = monitor.interval();
+
+    // Запускаем граф столько раз, сколько итераций осталось до проверки
+    // (не меньше одного раза - это и есть спекулятивная пачка в режиме pipeline)
+    auto batchLaunches = [&]() {
+        int launches = std::max(1, (nextCheck - iter) / settings.batch);
+        return std::min(launches, (iterations - iter + settings.batch - 1) / settings.batch);
+    };
+
+    if (!settings.pipeline) {
+        while (iter < iterations && error > eps) {
+            int launches = batchLaunches();
+            {
+                PROFILE_RANGE("sweep");
+                for (int i = 0; i < launches; i++) {
+                    cudaGraphLaunch(*graphExec, *stream);
+                }
             }
+            iter += launches * settings.batch;
 
-            iterate<<<gridDim, blockDim, 0, *stream>>>(A_link, Anew_link, size);
-            compute_error<32><<<gridDim, blockDim, 0, *stream>>>(A_link, Anew_link, errors_link, size);
-
-            // End capturing the graph
-            cudaStreamEndCapture(*stream, graph.get());
-            
-            // Creates an executable graph from a graph
-            cudaGraphInstantiate(graphExec.get(), *graph, nullptr, nullptr, 0);
-
-            graphCreated = true;
-        } 
-        else 
-        {
-            // Launch graph while err <= eps
-            cudaGraphLaunch(*graphExec, *stream);
+            PROFILE_RANGE("residual");
+            launchComputeError(gridDim, blockDim, *stream, Anew_link, A_link, errors_link, size);
             cudaStreamSynchronize(*stream);
 
             errors.copyToHost();
             error = *std::max_element(errors.arr.begin(), errors.arr.end());
-            iter += 1000;
+            PROFILE_COUNTER("error", error);
+            monitor.record(iter, error);
+            nextCheck = iter + monitor.interval();
+        }
+    } else {
+        // Пачка k+1 ставится в поток до того, как прочитана ошибка пачки k:
+        // ошибка сводится к одному числу на устройстве и асинхронно копируется
+        // в закреплённый буфер, а хост лишь опрашивает событие.
+        // Два слота, чтобы копия пачки k+1 не затёрла ещё не прочитанную ошибку пачки k.
+        Data<double> deviceError(2);
+        double* pinned = nullptr;
+        cudaMallocHost((void**)&pinned, 2 * sizeof(double));
+        std::unique_ptr<double, void(*)(double*)> hostError(pinned, [](double* p) { cudaFreeHost(p); });
+
+        cudaEvent_t ready[2];
+        int batchEnd[2];
+        for (int i = 0; i < 2; i++) {
+            cudaEventCreateWithFlags(&ready[i], cudaEventDisableTiming);
+        }
+
+        auto submit = [&](int slot) {
+            PROFILE_RANGE("submit");
+            int launches = batchLaunches();
+            for (int i = 0; i < launches; i++) {
+                cudaGraphLaunch(*graphExec, *stream);
+            }
+            iter += launches * settings.batch;
+            batchEnd[slot] = iter;
+
+            double* slotError = deviceError.getDevicePointer() + slot;
+            launchComputeError(gridDim, blockDim, *stream, Anew_link, A_link, errors_link, size);
+            LAUNCH(reduce_max<256>, dim3(1), dim3(256), *stream, errors_link, totalBlocks, slotError);
+            cudaMemcpyAsync(hostError.get() + slot, slotError, sizeof(double), cudaMemcpyDeviceToHost, *stream);
+            cudaEventRecord(ready[slot], *stream);
+        };
+
+        auto receive = [&](int slot) {
+            {
+                PROFILE_RANGE("residual");
+                while (cudaEventQuery(ready[slot]) == cudaErrorNotReady) {
+                    std::this_thread::yield();
+                }
+            }
+            error = hostError.get()[slot];
+            PROFILE_COUNTER("error", error);
+            monitor.record(batchEnd[slot], error);
+            nextCheck = batchEnd[slot] + monitor.interval();
+        };
+
+        int slot = 0;
+        submit(slot);
+        while (true) {
+            bool more = iter < iterations;
+            if (more) submit(1 - slot);
+            receive(slot);
+
+            if (error <= eps || !more) {
+                // Лишняя пачка уже посчитана и входит в iter - отчёт по её ошибке
+                if (more) receive(1 - slot);
+                break;
+            }
+            slot = 1 - slot;
+        }
+        cudaStreamSynchronize(*stream);
+
+        for (int i = 0; i < 2; i++) {
+            cudaEventDestroy(ready[i]);
         }
     }
 
-    A.copyToHost();
+    Anew.copyToHost();
+
+    if (!historyFile.empty()) monitor.save(historyFile);
+    return { iter, error, monitor.checks() };
+}
+
+int main(int argc, char const *argv[]) {
+    po::options_description desc("options");
+    desc.add_options()
+        ("eps", po::value<double>()->default_value(1e-6),"Accuracy")
+        ("size", po::value<int>()->default_value(10),"Matrix size")
+        ("iterations", po::value<int>()->default_value(1000000),"Max count of iteration")
+        ("show", po::value<bool>()->default_value(false),"Show ResMatrix")
+        ("history", po::value<std::string>()->default_value(""),"Write error history to file")
+        ("format", po::value<std::string>()->default_value("text"),"Output format: text, grid or lossy")
+        ("error-bound", po::value<double>()->default_value(1e-4),"Max absolute error of the lossy format")
+        ("pipeline", po::value<bool>()->default_value(false),"Overlap error readback with the next batch")
+        ("block", po::value<int>()->default_value(BLOCK),"Thread block side: 8, 16 or 32")
+        ("batch", po::value<int>()->default_value(GRAPH_BATCH),"Iterations per CUDA graph (even)")
+        ("help", "Show all all command");
+    addTuningOptions(desc);
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << "\n";
+        return 1;
+    }
+
+    double eps = vm["eps"].as<double>();
+    int size = vm["size"].as<int>();
+    int iterations = vm["iterations"].as<int>();
+    bool showResult = vm["show"].as<bool>();
+    std::string historyFile = vm["history"].as<std::string>();
+
+    bool binaryOutput;
+    GridOptions gridOptions;
+    if (!parseGridFormat(vm["format"].as<std::string>(), vm["error-bound"].as<double>(), binaryOutput, gridOptions)) return 1;
+    bool pipeline = vm["pipeline"].as<bool>();
+
+    std::cout << "Current settings:" << std::endl;
+    std::cout << "\tEPS: " << eps << std::endl;
+    std::cout << "\tMax iteration: " << iterations << std::endl;
+    std::cout << "\tSize: " << size << 'x' << size << std::endl;
+
+    Settings settings{ vm["block"].as<int>(), vm["batch"].as<int>(), pipeline };
+
+    // Пробные прогоны: фиксированное число итераций без остановки по точности.
+    // Сетка полная - от её размера зависит загрузка устройства, - а итераций не больше,
+    // чем укладывается в TUNE_CELL_UPDATES обновлений; кратно 200, то есть любой пачке.
+    // Интервал проверки сходимости не настраивается: монитор подбирает его по ходу
+    // решения, а пробы без остановки по точности его не измеряют
+    const int trialIterations = std::clamp(int(TUNE_CELL_UPDATES / (double(size) * size)) / 200 * 200,
+                                           200, TUNE_ITERATIONS);
+    TuningCache cache("task8", "size=" + std::to_string(size), vm["tuning-file"].as<std::string>());
+    TuneParams tuned;
+    if (vm["tune"].as<bool>()) {
+        auto candidates = tuneGrid({ { "block", { "8", "16", "32" } }, { "batch", { "20", "50", "100", "200" } } });
+        auto [best, seconds] = autotune(candidates, [&](TuneParams p) {
+            Data<double> A(size_sq);
+            Data<double> Anew(size_sq);
+            initMatrix(A.arr, size);
+            initMatrix(Anew.arr, size);
+
+            Settings trial{ std::stoi(p["block"]), std::stoi(p["batch"]), pipeline };
+            auto begin = std::chrono::high_resolution_clock::now();
+            solve(A, Anew, size, 0.0, trialIterations, trial, "");
+            return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+        });
+        if (cache.save(best, seconds)) std::cout << "Saved to " << cache.filename() << "\n";
+        tuned = best;
+    } else {
+        cache.load(tuned);
+    }
+    // Значения из файла проверяются ниже вместе с заданными явно
+    if (vm["block"].defaulted()) paramInt(tuned, "block", settings.block);
+    if (vm["batch"].defaulted()) paramInt(tuned, "batch", settings.batch);
+
+    if (settings.block != 8 && settings.block != 16 && settings.block != 32) {
+        std::cerr << "Block must be 8, 16 or 32\n";
+        return 1;
+    }
+    if (settings.batch <= 0 || settings.batch % 2 != 0) {
+        std::cerr << "Batch must be a positive even number\n";
+        return 1;
+    }
+
+    std::cout << "\tBlock: " << settings.block << 'x' << settings.block << ", batch: " << settings.batch << std::endl;
+
+    Data<double> A(size_sq);
+    Data<double> Anew(size_sq);
+
+    {
+        PROFILE_RANGE("init");
+        initMatrix(A.arr, size);
+        initMatrix(Anew.arr, size);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    Result result = solve(A, Anew, size, eps, iterations, settings, historyFile);
 
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsed = end - start;
 
-    std::cout << "Iterations: " << iter << "\n";
+    std::cout << "Iterations: " << result.iterations << "\n";
     std::cout << "Time: " << elapsed.count() << " s\n";
-    std::cout << "Error: " << error << "\n";
-
-    if(showResult) saveMatrix(A.arr.data(), size, "result_matrix.txt");
+    std::cout << "Error: " << result.error << "\n";
+    std::cout << "Error checks: " << result.checks << "\n";
+
+    bool saved = true;
+    if(showResult) {
+        PROFILE_RANGE("io");
+        if (binaryOutput) saved = saveGrid(Anew.arr.data(), size, size, "result_matrix.grd", gridOptions);
+        else saveMatrix(Anew.arr.data(), size, "result_matrix.txt");
+    }
+    PROFILE_REPORT();
 
-    return 0;
+    return saved ? 0 : 1;
 }
 
 